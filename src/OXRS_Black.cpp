@@ -4,40 +4,290 @@
 
 #include "Arduino.h"
 #include "OXRS_Black.h"
+#include "OXRS_SchemaValidator.h"
+#include "OXRS_ConfigDiff.h"
+#include "OXRS_Hash.h"
+#include "OXRS_CpuMeter.h"
+#include "OXRS_MeteredClient.h"
+#include "OXRS_Trace.h"
+#include "OXRS_LatencyProbe.h"
+#include "OXRS_LcdScheduler.h"
+#include "OXRS_DhcpLease.h"
+#include "OXRS_W5500Irq.h"
+#include "OXRS_W5500Health.h"
 
 #include <Wire.h>                     // For I2C
 #include <Ethernet.h>                 // For networking
 #include <WiFi.h>                     // Required for Ethernet to get MAC
 #include <LittleFS.h>                 // For file system access
-#include <MqttLogger.h>               // For logging
+#include <type_traits>                // For std::conditional
 
 // Macro for converting env vars to strings
 #define STRINGIFY(s) STRINGIFY1(s)
 #define STRINGIFY1(s) #s
 
+// Policy this library is built for
+typedef OXRS_BLACK_POLICY _policy;
+
+static_assert(!_policy::lcdTask || _policy::lcd, "policy draws the LCD from a task but disables the LCD");
+static_assert(_policy::outboundQueueSize > 0, "policy outbound queue size must be at least 1");
+static_assert(_policy::outboundMessagesPerLoop > 0, "policy must publish at least 1 outbound message per loop");
+static_assert((_policy::traceBufferSize & (_policy::traceBufferSize - 1)) == 0, "policy trace buffer size must be a power of 2");
+
+/* Stand-ins for subsystems disabled by the policy */
+class OXRS_NullServer
+{
+  public:
+    OXRS_NullServer(uint16_t) {}
+    void begin(void) {}
+    EthernetClient available(void) { return EthernetClient(); }
+};
+
+class OXRS_NullAPI
+{
+  public:
+    OXRS_NullAPI(OXRS_MQTT &) : _onAdopt(NULL) {}
+    void begin(void) {}
+    void loop(Client *) {}
+    void get(const char *, Router::Middleware *) {}
+    void post(const char *, Router::Middleware *) {}
+    void onAdopt(jsonCallback callback) { _onAdopt = callback; }
+
+    // Adoption info is still published to MQTT on connect
+    JsonVariant getAdopt(JsonVariant json) { if (_onAdopt) { _onAdopt(json); } return json; }
+
+  private:
+    jsonCallback _onAdopt;
+};
+
+class OXRS_NullLCD
+{
+  public:
+    OXRS_NullLCD(EthernetClass &, OXRS_MQTT &) {}
+    void begin(void) {}
+    int drawHeader(const char *, const char *, const char *, const char *, const uint8_t *) { return 0; }
+    void loop(void) {}
+    void showEvent(const char *) {}
+    void triggerMqttRxLed(void) {}
+    void triggerMqttTxLed(void) {}
+    void setBrightnessOn(int) {}
+    void setBrightnessDim(int) {}
+    void setOnTimeDisplay(int) {}
+    void setOnTimeEvent(int) {}
+};
+
+class OXRS_NullLcdScheduler
+{
+  public:
+    OXRS_NullLcdScheduler() : framesDrawn(0), eventsDropped(0) {}
+    void setFrameRate(uint8_t) {}
+    void showEvent(const char *) {}
+    void triggerMqttRxLed(void) {}
+    void triggerMqttTxLed(void) {}
+    template <class Lock, class Screen> bool render(Screen &) { return false; }
+    void getJson(JsonVariant) {}
+
+    uint32_t framesDrawn;
+    uint32_t eventsDropped;
+};
+
+#if defined(OXRS_LCD_ENABLE)
+typedef std::conditional<_policy::lcd, OXRS_LCD, OXRS_NullLCD>::type _screen_t;
+#else
+static_assert(!_policy::lcd, "policy enables the LCD but OXRS_LCD_DISABLE is defined");
+typedef OXRS_NullLCD _screen_t;
+#endif
+
 // Network client (for MQTT)/server (for REST API)
 EthernetClient _client;
-EthernetServer _server(REST_API_PORT);
+std::conditional<_policy::restApi, EthernetServer, OXRS_NullServer>::type _server(REST_API_PORT);
+
+// DHCP lease, cached so it can be reacquired quickly after a restart
+OXRS_DhcpLease _dhcpLease;
+
+// W5500 interrupt (if wired), and when we last polled/checked the link
+OXRS_W5500Irq _networkIrq;
+int16_t _networkIrqPin = -1;
+uint32_t _networkPolledMs = 0;
+uint32_t _linkCheckedMs = 0;
+bool _linkUp = false;
+
+// PubSubClient handles one packet per loop, so in interrupt mode we keep
+// servicing MQTT while anything is left over (read ahead, or on the W5500)
+bool _mqttBacklog = false;
+
+// W5500 health monitor, resetting the chip in place if it wedges
+OXRS_W5500Health _networkHealth;
+
+// Wrappers counting the bytes in/out of each socket (for /metrics), and
+// coalescing small writes into a single send (sized by setSocketBuffers())
+OXRS_MeteredClient _mqttSocket(&_client);
+OXRS_MeteredClient _apiSocket;
+
+const uint16_t SOCKET_BUFFER_PRESETS[][2] =
+{
+  // mqtt, api
+  { 1024, 1024 },   // SOCKET_BUFFERS_BALANCED
+  { 2048, 256 },    // SOCKET_BUFFERS_MQTT_HEAVY
+  { 512, 2048 },    // SOCKET_BUFFERS_API_HEAVY
+};
+
+// Write buffering is opt-in, so direct publishes go out as they always have
+uint16_t _mqttBufferSize = 0;
+uint16_t _apiBufferSize = 0;
 
 // MQTT client
-PubSubClient _mqttClient(_client);
+PubSubClient _mqttClient(_mqttSocket);
 OXRS_MQTT _mqtt(_mqttClient);
 
 // REST API
-OXRS_API _api(_mqtt);
+std::conditional<_policy::restApi, OXRS_API, OXRS_NullAPI>::type _api(_mqtt);
+
+// LCD screen, redrawn at a limited frame rate
+_screen_t _screen(Ethernet, _mqtt);
+std::conditional<_policy::lcd, OXRS_LcdScheduler, OXRS_NullLcdScheduler>::type _lcdScheduler;
+
+// The W5500 and LCD share the SPI bus, so when the LCD is drawn from its
+// own task every bus access is serialised (otherwise compiles to nothing)
+SemaphoreHandle_t _spiMutex = _policy::lcdTask ? xSemaphoreCreateRecursiveMutex() : NULL;
+
+class OXRS_SpiLock
+{
+  public:
+    OXRS_SpiLock() { if (_policy::lcdTask) { xSemaphoreTakeRecursive(_spiMutex, portMAX_DELAY); } }
+    ~OXRS_SpiLock() { if (_policy::lcdTask) { xSemaphoreGiveRecursive(_spiMutex); } }
+};
+
+// Outbound MQTT traffic, queued per class and published in priority order
+OXRS_Outbound _outbound(_mqttClient, _policy::outboundQueueSize);
 
-// LCD screen
-OXRS_LCD _screen(Ethernet, _mqtt);
+// Broker round-trip time probe (topic set once MQTT connects successfully),
+// published as telemetry so probes are subject to the same rate limit
+OXRS_LatencyProbe _latencyProbe(_outbound, _mqttClient);
 
 // Logging (topic updated once MQTT connects successfully)
-MqttLogger _logger(_mqttClient, "log", MqttLoggerMode::MqttAndSerial);
+_policy::Logger _logger(_outbound, _mqttClient);
 
 // Firmware logo
 const uint8_t * _fwLogo;
  
 // Supported firmware config and command schemas
-JsonDocument _fwConfigSchema;
-JsonDocument _fwCommandSchema;
+JsonDocument _fwConfigSchema(_policy::jsonAllocator());
+JsonDocument _fwCommandSchema(_policy::jsonAllocator());
+
+// Compiled config and command schemas, for validating incoming payloads
+OXRS_SchemaValidator _configValidator;
+OXRS_SchemaValidator _commandValidator;
+
+// Keyed config and command handlers
+OXRS_HandlerRegistry _configHandlers;
+OXRS_HandlerRegistry _commandHandlers;
+
+// Hashes of the last applied config, so unchanged config can be skipped
+OXRS_ConfigDiff _configDiff;
+bool _configDiffing = true;
+
+// Last full config payload from the broker (the retained config), persisted
+// to file as is so anything removed from it is also removed from the file
+JsonDocument _config(_policy::jsonAllocator());
+uint32_t _configFileHash = 0;
+uint32_t _configChangedMs = 0;
+uint32_t _configWrittenMs = 0;
+uint32_t _configFailedMs = 0;
+bool _configDirty = false;
+bool _configWritten = false;
+bool _configFailed = false;
+
+// System info which is expensive to read, so cached
+struct
+{
+  bool valid;
+  uint32_t flashChipSize;
+  uint32_t sketchSize;
+  uint32_t sketchSpaceTotal;
+  size_t fileSystemUsed;
+  size_t fileSystemTotal;
+  uint32_t fileSystemReadMs;
+  bool fileSystemStale;
+} _systemCache;
+
+// Heap low-water marks (sampled from loop)
+struct
+{
+  uint32_t minMaxAlloc;
+  uint8_t maxFragmentation;
+  uint32_t sampledMs;
+} _heapStats = { UINT32_MAX, 0, 0 };
+
+// Per-core utilisation, and library vs firmware share of the loop task
+OXRS_CpuMeter _cpuMeter;
+
+// Event trace exposed on /trace
+OXRS_Trace _trace(_policy::traceBufferSize);
+
+// Counters exposed on /metrics
+const uint32_t LOOP_HISTOGRAM_US[LOOP_HISTOGRAM_BUCKETS] = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000 };
+const char * LOOP_HISTOGRAM_LE[LOOP_HISTOGRAM_BUCKETS] = { "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1" };
+
+// See https://github.com/OXRS-IO/OXRS-IO-MQTT-ESP32-LIB/blob/main/src/OXRS_MQTT.h
+const char * RECEIVE_RESULTS[] = { "ok", "zero_length", "json_error", "no_config_handler", "no_command_handler" };
+#define       RECEIVE_RESULT_COUNT        (sizeof(RECEIVE_RESULTS) / sizeof(RECEIVE_RESULTS[0]))
+
+// Indexed by state - MQTT_CONNECTION_TIMEOUT (i.e. -4 is index 0)
+const char * DISCONNECT_REASONS[] = { "connection_timeout", "connection_lost", "connect_failed", "disconnected", "connected", "bad_protocol", "bad_client_id", "unavailable", "bad_credentials", "unauthorized" };
+#define       DISCONNECT_REASON_COUNT     (sizeof(DISCONNECT_REASONS) / sizeof(DISCONNECT_REASONS[0]))
+
+struct
+{
+  uint32_t loopBuckets[LOOP_HISTOGRAM_BUCKETS + 1];
+  uint64_t loopSumUs;
+  uint32_t loopCount;
+
+  uint32_t received[RECEIVE_RESULT_COUNT];
+  uint32_t connects;
+  uint32_t disconnects[DISCONNECT_REASON_COUNT];
+} _metrics;
+
+// Tasks we report stack high-water marks for
+TaskHandle_t _trackedTasks[MAX_TRACKED_TASKS];
+uint8_t _trackedTaskCount = 0;
+
+// Phases of begin(), timed as start/end ms since begin() was called so
+// any overlap is visible, plus when we first touched the network (i.e. sent
+// our first DHCP request) and were ready, since power on
+const char * BOOT_PHASES[] = { "screen", "wiznetReset", "fileSystem", "config", "dhcp", "mqtt", "api" };
+#define       BOOT_PHASE_COUNT            (sizeof(BOOT_PHASES) / sizeof(BOOT_PHASES[0]))
+
+#define       BOOT_SCREEN                 0
+#define       BOOT_WIZNET_RESET           1
+#define       BOOT_FILE_SYSTEM            2
+#define       BOOT_CONFIG                 3
+#define       BOOT_DHCP                   4
+#define       BOOT_MQTT                   5
+#define       BOOT_API                    6
+
+struct
+{
+  uint32_t beginMs;
+  uint32_t startMs[BOOT_PHASE_COUNT];
+  uint32_t endMs[BOOT_PHASE_COUNT];
+  uint32_t firstNetworkMs;
+  uint32_t readyMs;
+} _bootStats;
+
+// Result of drawing the screen header, logged once the boot task is done
+int _bootScreenResult = 0;
+
+// Periodic system telemetry (if enabled)
+uint32_t _systemTelemetryMs = 0;
+uint32_t _systemTelemetryLastMs = 0;
+
+// Status events batched into a single payload (if enabled)
+JsonDocument _statusBatch(_policy::jsonAllocator());
+uint16_t _statusBatchWindowMs = 0;
+uint8_t _statusBatchMaxEvents = 0;
+uint32_t _statusBatchStartMs = 0;
+char _statusBatchEvent[_policy::lcd ? LCD_EVENT_SIZE : 1];
 
 // MQTT callbacks wrapped by _mqttConfig/_mqttCommand
 jsonCallback _onConfig;
@@ -66,6 +316,76 @@ void _mergeJson(JsonVariant dst, JsonVariantConst src)
   }
 }
 
+/* Outbound helpers */
+bool _isMqttConnected(void)
+{
+  // Asks the W5500, so must not overlap an LCD draw
+  OXRS_SpiLock lock;
+  return _mqtt.connected();
+}
+
+bool _isOutboundQueued(void)
+{
+  for (uint8_t lane = 0; lane < OUTBOUND_LANES; lane++)
+  {
+    if (_outbound.queued(lane) > 0) { return true; }
+  }
+  return false;
+}
+
+bool _sendMqttSocket(void)
+{
+  // Each publish is pushed out of the socket write buffer as it is made,
+  // so a failed send counts against that message
+  return _mqttSocket.push();
+}
+
+bool _publishJson(uint8_t lane, const char * topic, JsonVariant json, bool retained)
+{
+  OXRS_TraceScope trace(_trace, "publish");
+
+  // Don't queue anything we have no chance of publishing
+  if (!_isMqttConnected()) { return false; }
+  if (!_outbound.enqueue(lane, topic, json, retained)) { return false; }
+
+  // Status and replies go out immediately, anything else when loop() gets to it
+  if (lane > OUTBOUND_REPLY) { return true; }
+
+  OXRS_SpiLock lock;
+  return _outbound.flush(lane);
+}
+
+/* Status helpers */
+bool _formatEvent(JsonVariant json, char * event)
+{
+  if (!json.containsKey("index")) { return false; }
+
+  // Pad the index to 3 chars - to ensure a consistent display for all indices
+  sprintf_P(event, PSTR("[%3d]"), json["index"].as<uint8_t>());
+
+  if (json.containsKey("type") && json.containsKey("event"))
+  {
+    if (strcmp(json["type"], json["event"]) == 0)
+    {
+      sprintf_P(event, PSTR("%s %s"), event, json["type"].as<const char *>());
+    }
+    else
+    {
+      sprintf_P(event, PSTR("%s %s %s"), event, json["type"].as<const char *>(), json["event"].as<const char *>());
+    }
+  }
+  else if (json.containsKey("type"))
+  {
+    sprintf_P(event, PSTR("%s %s"), event, json["type"].as<const char *>());
+  }
+  else if (json.containsKey("event"))
+  {
+    sprintf_P(event, PSTR("%s %s"), event, json["event"].as<const char *>());
+  }
+
+  return true;
+}
+
 /* Adoption info builders */
 void _getFirmwareJson(JsonVariant json)
 {
@@ -81,20 +401,126 @@ void _getFirmwareJson(JsonVariant json)
 #endif
 }
 
+void _refreshSystemCache(void)
+{
+  // These never change while we are running, and getSketchSize() in
+  // particular has to read the whole app partition to work it out
+  if (!_systemCache.valid)
+  {
+    _systemCache.flashChipSize = ESP.getFlashChipSize();
+    _systemCache.sketchSize = ESP.getSketchSize();
+    _systemCache.sketchSpaceTotal = ESP.getFreeSketchSpace();
+    _systemCache.fileSystemTotal = LittleFS.totalBytes();
+    _systemCache.fileSystemStale = true;
+    _systemCache.valid = true;
+  }
+
+  // usedBytes() walks the file system, so only re-read it periodically
+  // or after we have written something ourselves
+  if (_systemCache.fileSystemStale || (millis() - _systemCache.fileSystemReadMs) >= FS_USAGE_REFRESH_MS)
+  {
+    _systemCache.fileSystemUsed = LittleFS.usedBytes();
+    _systemCache.fileSystemReadMs = millis();
+    _systemCache.fileSystemStale = false;
+  }
+}
+
+void _getBootJson(JsonVariant json)
+{
+  JsonObject boot = json["bootMs"].to<JsonObject>();
+
+  // [start, end] of each phase
+  for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++)
+  {
+    JsonArray phase = boot[BOOT_PHASES[i]].to<JsonArray>();
+    phase.add(_bootStats.startMs[i]);
+    phase.add(_bootStats.endMs[i]);
+  }
+
+  boot["firstNetwork"] = _bootStats.firstNetworkMs;
+  boot["ready"] = _bootStats.readyMs;
+}
+
+/* Heap/stack monitoring */
+uint8_t _getFragmentation(uint32_t freeBytes, uint32_t maxAlloc)
+{
+  // Percentage of free heap not available as a single block - the two
+  // are read separately so the largest block can exceed the free total
+  if (maxAlloc >= freeBytes) { return 0; }
+  return 100 - (uint8_t)(((uint64_t)maxAlloc * 100) / freeBytes);
+}
+
+void _sampleHeap(void)
+{
+  _heapStats.sampledMs = millis();
+
+  uint32_t freeBytes = ESP.getFreeHeap();
+  uint32_t maxAlloc = ESP.getMaxAllocHeap();
+  if (maxAlloc < _heapStats.minMaxAlloc) { _heapStats.minMaxAlloc = maxAlloc; }
+
+  uint8_t fragmentation = _getFragmentation(freeBytes, maxAlloc);
+  if (fragmentation > _heapStats.maxFragmentation) { _heapStats.maxFragmentation = fragmentation; }
+}
+
+void _trackTask(TaskHandle_t task)
+{
+  if (!task || _trackedTaskCount >= MAX_TRACKED_TASKS) { return; }
+
+  for (uint8_t i = 0; i < _trackedTaskCount; i++)
+  {
+    if (_trackedTasks[i] == task) { return; }
+  }
+
+  _trackedTasks[_trackedTaskCount++] = task;
+}
+
 void _getSystemJson(JsonVariant json)
 {
   JsonObject system = json["system"].to<JsonObject>();
 
+  _refreshSystemCache();
+
   system["heapUsedBytes"] = ESP.getHeapSize();
   system["heapFreeBytes"] = ESP.getFreeHeap();
   system["heapMaxAllocBytes"] = ESP.getMaxAllocHeap();
-  system["flashChipSizeBytes"] = ESP.getFlashChipSize();
 
-  system["sketchSpaceUsedBytes"] = ESP.getSketchSize();
-  system["sketchSpaceTotalBytes"] = ESP.getFreeSketchSpace();
+  // Low-water marks since boot, to spot leaks and fragmentation early
+  _sampleHeap();
+
+  system["heapMinFreeBytes"] = ESP.getMinFreeHeap();
+  system["heapMinMaxAllocBytes"] = _heapStats.minMaxAlloc;
+  system["heapFragmentationPercent"] = _getFragmentation(ESP.getFreeHeap(), ESP.getMaxAllocHeap());
+  system["heapMaxFragmentationPercent"] = _heapStats.maxFragmentation;
+
+  // Stack high-water marks (i.e. minimum free stack, in bytes)
+  JsonObject stack = system["stackFreeBytes"].to<JsonObject>();
+  for (uint8_t i = 0; i < _trackedTaskCount; i++)
+  {
+    stack[pcTaskGetName(_trackedTasks[i])] = uxTaskGetStackHighWaterMark(_trackedTasks[i]);
+  }
+
+  // CPU utilisation over the last sample window
+  _cpuMeter.getJson(system);
+
+  // MQTT broker round-trip times
+  _latencyProbe.getJson(system);
+
+  // How long we took to boot
+  _getBootJson(system);
 
-  system["fileSystemUsedBytes"] = LittleFS.usedBytes();
-  system["fileSystemTotalBytes"] = LittleFS.totalBytes();
+  // Times the W5500 wedged and was reset
+  system["networkRecoveries"] = _networkHealth.recoveries;
+
+  // LCD frames drawn vs events dropped
+  if (_policy::lcd) { _lcdScheduler.getJson(system); }
+
+  system["flashChipSizeBytes"] = _systemCache.flashChipSize;
+
+  system["sketchSpaceUsedBytes"] = _systemCache.sketchSize;
+  system["sketchSpaceTotalBytes"] = _systemCache.sketchSpaceTotal;
+
+  system["fileSystemUsedBytes"] = _systemCache.fileSystemUsed;
+  system["fileSystemTotalBytes"] = _systemCache.fileSystemTotal;
 }
 
 void _getNetworkJson(JsonVariant json)
@@ -129,7 +555,24 @@ void _getConfigSchemaJson(JsonVariant json)
     _mergeJson(properties, _fwConfigSchema.as<JsonVariant>());
   }
 
+  // Telemetry config
+  JsonObject systemTelemetrySeconds = properties["systemTelemetrySeconds"].to<JsonObject>();
+  systemTelemetrySeconds["title"] = "System Telemetry Interval (seconds)";
+  systemTelemetrySeconds["description"] = "How often to publish system telemetry, i.e. heap, flash and file system usage (defaults to 0, which disables it). Must be a number between 0 and 86400 (i.e. 1 day).";
+  systemTelemetrySeconds["type"] = "integer";
+  systemTelemetrySeconds["minimum"] = 0;
+  systemTelemetrySeconds["maximum"] = 86400;
+
+  JsonObject latencyProbeSeconds = properties["latencyProbeSeconds"].to<JsonObject>();
+  latencyProbeSeconds["title"] = "MQTT Latency Probe Interval (seconds)";
+  latencyProbeSeconds["description"] = "How often to measure the round-trip time to the MQTT broker, reported in system telemetry (defaults to 0, which disables it). Must be a number between 0 and 3600 (i.e. 1 hour).";
+  latencyProbeSeconds["type"] = "integer";
+  latencyProbeSeconds["minimum"] = 0;
+  latencyProbeSeconds["maximum"] = 3600;
+
   // LCD config
+  if (!_policy::lcd) { return; }
+
   JsonObject activeBrightnessPercent = properties["activeBrightnessPercent"].to<JsonObject>();
   activeBrightnessPercent["title"] = "LCD Active Brightness (%)";
   activeBrightnessPercent["description"] = "Brightness of the LCD when active (defaults to 100%). Must be a number between 0 and 100.";
@@ -157,6 +600,13 @@ void _getConfigSchemaJson(JsonVariant json)
   eventDisplaySeconds["type"] = "integer";
   eventDisplaySeconds["minimum"] = 0;
   eventDisplaySeconds["maximum"] = 600;
+
+  JsonObject lcdFrameRate = properties["lcdFrameRate"].to<JsonObject>();
+  lcdFrameRate["title"] = "LCD Frame Rate (per second)";
+  lcdFrameRate["description"] = "Maximum number of LCD redraws per second, bursts of events are coalesced and only the latest shown (defaults to 10, setting to 0 redraws on every loop). Must be a number between 0 and 50.";
+  lcdFrameRate["type"] = "integer";
+  lcdFrameRate["minimum"] = 0;
+  lcdFrameRate["maximum"] = 50;
 }
 
 void _getCommandSchemaJson(JsonVariant json)
@@ -182,278 +632,656 @@ void _getCommandSchemaJson(JsonVariant json)
   restart["type"] = "boolean";
 }
 
-/* API callbacks */
-void _apiAdopt(JsonVariant json)
+/* Schema validation */
+void _compileConfigSchema(void)
 {
-  // Build device adoption info
-  _getFirmwareJson(json);
-  _getSystemJson(json);
-  _getNetworkJson(json);
-  _getConfigSchemaJson(json);
-  _getCommandSchemaJson(json);
+  JsonDocument json(_policy::jsonAllocator());
+  _getConfigSchemaJson(json.as<JsonVariant>());
+  _configValidator.compile(json["configSchema"]["properties"]);
 }
 
-/* MQTT callbacks */
-void _mqttConnected() 
+void _compileCommandSchema(void)
 {
-  // MqttLogger doesn't copy the logging topic to an internal
-  // buffer so we have to use a static array here
-  static char logTopic[64];
-  _logger.setTopic(_mqtt.getLogTopic(logTopic));
-
-  // Publish device adoption info
-  JsonDocument json;
-  _mqtt.publishAdopt(_api.getAdopt(json.as<JsonVariant>()));
-
-  // Log the fact we are now connected
-  _logger.println("[black] mqtt connected");
+  JsonDocument json(_policy::jsonAllocator());
+  _getCommandSchemaJson(json.as<JsonVariant>());
+  _commandValidator.compile(json["commandSchema"]["properties"]);
 }
 
-void _mqttDisconnected(int state) 
+void _schemaError(const char * parent, const char * key, uint8_t error)
 {
-  // Log the disconnect reason
-  // See https://github.com/knolleary/pubsubclient/blob/2d228f2f862a95846c65a8518c79f48dfc8f188c/src/PubSubClient.h#L44
-  switch (state)
+  _logger.print(F("[black] invalid "));
+  if (parent)
   {
-    case MQTT_CONNECTION_TIMEOUT:
-      _logger.println(F("[black] mqtt connection timeout"));
-      break;
-    case MQTT_CONNECTION_LOST:
-      _logger.println(F("[black] mqtt connection lost"));
-      break;
-    case MQTT_CONNECT_FAILED:
-      _logger.println(F("[black] mqtt connect failed"));
+    _logger.print(parent);
+    _logger.print(F("."));
+  }
+  _logger.print(key);
+
+  switch (error)
+  {
+    case SCHEMA_ERR_TYPE:
+      _logger.println(F(", wrong type"));
       break;
-    case MQTT_DISCONNECTED:
-      _logger.println(F("[black] mqtt disconnected"));
+    case SCHEMA_ERR_MINIMUM:
+      _logger.println(F(", below minimum"));
       break;
-    case MQTT_CONNECT_BAD_PROTOCOL:
-      _logger.println(F("[black] mqtt bad protocol"));
+    case SCHEMA_ERR_MAXIMUM:
+      _logger.println(F(", above maximum"));
       break;
-    case MQTT_CONNECT_BAD_CLIENT_ID:
-      _logger.println(F("[black] mqtt bad client id"));
+    case SCHEMA_ERR_ENUM:
+      _logger.println(F(", not a valid option"));
       break;
-    case MQTT_CONNECT_UNAVAILABLE:
-      _logger.println(F("[black] mqtt unavailable"));
+    default:
+      _logger.println();
       break;
-    case MQTT_CONNECT_BAD_CREDENTIALS:
-      _logger.println(F("[black] mqtt bad credentials"));
-      break;      
-    case MQTT_CONNECT_UNAUTHORIZED:
-      _logger.println(F("[black] mqtt unauthorised"));
-      break;      
   }
 }
 
-void _mqttConfig(JsonVariant json)
+/* Metrics */
+void _recordLoopDuration(uint32_t durationUs)
 {
-  // LCD config
-  if (json.containsKey("activeBrightnessPercent"))
+  uint8_t bucket = 0;
+  while (bucket < LOOP_HISTOGRAM_BUCKETS && durationUs > LOOP_HISTOGRAM_US[bucket]) { bucket++; }
+
+  _metrics.loopBuckets[bucket]++;
+  _metrics.loopSumUs += durationUs;
+  _metrics.loopCount++;
+}
+
+void _printMetricType(Print & out, const char * name, const char * type)
+{
+  out.print(F("# TYPE oxrs_"));
+  out.print(name);
+  out.print(' ');
+  out.print(type);
+  out.print('\n');
+}
+
+void _printMetric(Print & out, const char * name, const char * label, const char * labelValue, uint64_t value)
+{
+  out.print(F("oxrs_"));
+  out.print(name);
+  if (label)
   {
-    _screen.setBrightnessOn(json["activeBrightnessPercent"].as<int>());
+    out.print('{');
+    out.print(label);
+    out.print(F("=\""));
+    out.print(labelValue);
+    out.print(F("\"}"));
   }
+  out.print(' ');
+  out.print(value);
+  out.print('\n');
+}
 
-  if (json.containsKey("inactiveBrightnessPercent"))
+// NOTE: the Prometheus text format requires \n line endings, so we
+//       can't use println() here
+void _printMetrics(Print & out)
+{
+  // Loop duration
+  _printMetricType(out, "loop_duration_seconds", "histogram");
+  uint64_t cumulative = 0;
+  for (uint8_t i = 0; i < LOOP_HISTOGRAM_BUCKETS; i++)
+  {
+    cumulative += _metrics.loopBuckets[i];
+    _printMetric(out, "loop_duration_seconds_bucket", "le", LOOP_HISTOGRAM_LE[i], cumulative);
+  }
+  _printMetric(out, "loop_duration_seconds_bucket", "le", "+Inf", _metrics.loopCount);
+  out.print(F("oxrs_loop_duration_seconds_sum "));
+  out.print(_metrics.loopSumUs / 1000000.0, 6);
+  out.print('\n');
+  _printMetric(out, "loop_duration_seconds_count", NULL, NULL, _metrics.loopCount);
+
+  // Outbound MQTT traffic per class
+  _printMetricType(out, "mqtt_published_total", "counter");
+  for (uint8_t i = 0; i < OUTBOUND_LANES; i++)
   {
-    _screen.setBrightnessDim(json["inactiveBrightnessPercent"].as<int>());
+    _printMetric(out, "mqtt_published_total", "class", OXRS_Outbound::getLaneName(i), _outbound.getStats(i)->published);
   }
 
-  if (json.containsKey("activeDisplaySeconds"))
+  _printMetricType(out, "mqtt_publish_failures_total", "counter");
+  for (uint8_t i = 0; i < OUTBOUND_LANES; i++)
   {
-    _screen.setOnTimeDisplay(json["activeDisplaySeconds"].as<int>());
+    _printMetric(out, "mqtt_publish_failures_total", "class", OXRS_Outbound::getLaneName(i), _outbound.getStats(i)->failed);
   }
-  
-  if (json.containsKey("eventDisplaySeconds"))
+
+  _printMetricType(out, "mqtt_dropped_total", "counter");
+  for (uint8_t i = 0; i < OUTBOUND_LANES; i++)
   {
-    _screen.setOnTimeEvent(json["eventDisplaySeconds"].as<int>());
+    _printMetric(out, "mqtt_dropped_total", "class", OXRS_Outbound::getLaneName(i), _outbound.getStats(i)->dropped);
   }
 
-  // Pass on to the firmware callback
-  if (_onConfig) { _onConfig(json); }
-}
+  _printMetricType(out, "mqtt_deferred_total", "counter");
+  for (uint8_t i = 0; i < OUTBOUND_LANES; i++)
+  {
+    _printMetric(out, "mqtt_deferred_total", "class", OXRS_Outbound::getLaneName(i), _outbound.getStats(i)->deferred);
+  }
 
-void _mqttCommand(JsonVariant json)
-{
-  // Check for Rack32 commands
-  if (json.containsKey("restart") && json["restart"].as<bool>())
+  _printMetricType(out, "mqtt_queued", "gauge");
+  for (uint8_t i = 0; i < OUTBOUND_LANES; i++)
   {
-    ESP.restart();
+    _printMetric(out, "mqtt_queued", "class", OXRS_Outbound::getLaneName(i), _outbound.queued(i));
   }
 
-  // Pass on to the firmware callback
-  if (_onCommand) { _onCommand(json); }
-}
+  // Inbound MQTT messages by result
+  _printMetricType(out, "mqtt_received_total", "counter");
+  for (uint8_t i = 0; i < RECEIVE_RESULT_COUNT; i++)
+  {
+    _printMetric(out, "mqtt_received_total", "result", RECEIVE_RESULTS[i], _metrics.received[i]);
+  }
 
-void _mqttCallback(char * topic, byte * payload, int length) 
-{
-  // Update screen
-  _screen.triggerMqttRxLed();
+  // MQTT connections and disconnect reasons
+  _printMetricType(out, "mqtt_connects_total", "counter");
+  _printMetric(out, "mqtt_connects_total", NULL, NULL, _metrics.connects);
 
-  // Pass down to our MQTT handler and check it was processed ok
-  int state = _mqtt.receive(topic, payload, length);
-  switch (state)
+  _printMetricType(out, "mqtt_disconnects_total", "counter");
+  for (uint8_t i = 0; i < DISCONNECT_REASON_COUNT; i++)
   {
-    case MQTT_RECEIVE_ZERO_LENGTH:
-      _logger.println(F("[black] empty mqtt payload received"));
-      break;
-    case MQTT_RECEIVE_JSON_ERROR:
-      _logger.println(F("[black] failed to deserialise mqtt json payload"));
-      break;
-    case MQTT_RECEIVE_NO_CONFIG_HANDLER:
-      _logger.println(F("[black] no mqtt config handler"));
-      break;
-    case MQTT_RECEIVE_NO_COMMAND_HANDLER:
-      _logger.println(F("[black] no mqtt command handler"));
-      break;
+    if (i == MQTT_CONNECTED - MQTT_CONNECTION_TIMEOUT) { continue; }
+    _printMetric(out, "mqtt_disconnects_total", "reason", DISCONNECT_REASONS[i], _metrics.disconnects[i]);
   }
-}
 
-/* Main program */
-OXRS_Black::OXRS_Black(const uint8_t * fwLogo)
-{
-  _fwLogo = fwLogo;
-}
+  // Heap
+  _printMetricType(out, "heap_free_bytes", "gauge");
+  _printMetric(out, "heap_free_bytes", NULL, NULL, ESP.getFreeHeap());
+  _printMetricType(out, "heap_min_free_bytes", "gauge");
+  _printMetric(out, "heap_min_free_bytes", NULL, NULL, ESP.getMinFreeHeap());
+  _printMetricType(out, "heap_max_alloc_bytes", "gauge");
+  _printMetric(out, "heap_max_alloc_bytes", NULL, NULL, ESP.getMaxAllocHeap());
+  _printMetricType(out, "heap_min_max_alloc_bytes", "gauge");
+  _printMetric(out, "heap_min_max_alloc_bytes", NULL, NULL, _heapStats.minMaxAlloc);
+
+  // MQTT broker round-trip time
+  _printMetricType(out, "mqtt_rtt_seconds", "histogram");
+  cumulative = 0;
+  for (uint8_t i = 0; i < LATENCY_PROBE_BUCKETS; i++)
+  {
+    char le[12];
+    sprintf_P(le, PSTR("%g"), OXRS_LatencyProbe::BUCKETS_MS[i] / 1000.0);
 
-void OXRS_Black::begin(jsonCallback config, jsonCallback command)
-{
-  // Get our firmware details
-  JsonDocument json;
-  _getFirmwareJson(json.as<JsonVariant>());
+    cumulative += _latencyProbe.buckets[i];
+    _printMetric(out, "mqtt_rtt_seconds_bucket", "le", le, cumulative);
+  }
+  _printMetric(out, "mqtt_rtt_seconds_bucket", "le", "+Inf", _latencyProbe.count);
+  out.print(F("oxrs_mqtt_rtt_seconds_sum "));
+  out.print(_latencyProbe.sumUs / 1000000.0, 6);
+  out.print('\n');
+  _printMetric(out, "mqtt_rtt_seconds_count", NULL, NULL, _latencyProbe.count);
 
-  // Log firmware details
-  _logger.print(F("[black] "));
-  serializeJson(json, _logger);
-  _logger.println();
+  _printMetricType(out, "mqtt_rtt_lost_total", "counter");
+  _printMetric(out, "mqtt_rtt_lost_total", NULL, NULL, _latencyProbe.lost);
 
-  // We wrap the callbacks so we can intercept messages intended for the Rack32
-  _onConfig = config;
-  _onCommand = command;
-  
-  // Set up the screen
-  _initialiseScreen();
+  // Socket traffic
+  _printMetricType(out, "socket_received_bytes_total", "counter");
+  _printMetric(out, "socket_received_bytes_total", "socket", "mqtt", _mqttSocket.bytesIn);
+  _printMetric(out, "socket_received_bytes_total", "socket", "api", _apiSocket.bytesIn);
 
-  // Set up network and obtain an IP address
-  byte mac[6];
-  _initialiseNetwork(mac);
+  _printMetricType(out, "socket_sent_bytes_total", "counter");
+  _printMetric(out, "socket_sent_bytes_total", "socket", "mqtt", _mqttSocket.bytesOut);
+  _printMetric(out, "socket_sent_bytes_total", "socket", "api", _apiSocket.bytesOut);
 
-  // Set up MQTT (don't attempt to connect yet)
-  _initialiseMqtt(mac);
+  _printMetricType(out, "socket_sends_total", "counter");
+  _printMetric(out, "socket_sends_total", "socket", "mqtt", _mqttSocket.sends);
+  _printMetric(out, "socket_sends_total", "socket", "api", _apiSocket.sends);
 
-  // Set up the REST API
-  _initialiseRestApi();
-}
+  _printMetricType(out, "socket_send_failures_total", "counter");
+  _printMetric(out, "socket_send_failures_total", "socket", "mqtt", _mqttSocket.sendFailures);
+  _printMetric(out, "socket_send_failures_total", "socket", "api", _apiSocket.sendFailures);
 
-void OXRS_Black::loop(void)
-{
-  // Check our network connection
-  if (_isNetworkConnected())
+  _printMetricType(out, "socket_receives_total", "counter");
+  _printMetric(out, "socket_receives_total", "socket", "mqtt", _mqttSocket.receives);
+  _printMetric(out, "socket_receives_total", "socket", "api", _apiSocket.receives);
+
+  _printMetricType(out, "network_recoveries_total", "counter");
+  _printMetric(out, "network_recoveries_total", NULL, NULL, _networkHealth.recoveries);
+
+  if (_networkIrq.enabled())
   {
-    // Maintain our DHCP lease
-    Ethernet.maintain();
-    
-    // Handle any MQTT messages
-    _mqtt.loop();
-    
-    // Handle any REST API requests
-    EthernetClient client = _server.available();
-    _api.loop(&client);
+    _printMetricType(out, "network_interrupts_total", "counter");
+    _printMetric(out, "network_interrupts_total", NULL, NULL, _networkIrq.serviced);
   }
-    
-  // Update screen
-  _screen.loop();
-}
 
-void OXRS_Black::setConfigSchema(JsonVariant json)
-{
-  _fwConfigSchema.clear();
-  _mergeJson(_fwConfigSchema.as<JsonVariant>(), json);
+  // LCD rendering
+  if (!_policy::lcd) { return; }
+
+  _printMetricType(out, "lcd_frames_total", "counter");
+  _printMetric(out, "lcd_frames_total", NULL, NULL, _lcdScheduler.framesDrawn);
+
+  _printMetricType(out, "lcd_events_dropped_total", "counter");
+  _printMetric(out, "lcd_events_dropped_total", NULL, NULL, _lcdScheduler.eventsDropped);
 }
 
-void OXRS_Black::setCommandSchema(JsonVariant json)
+/* Network helpers */
+bool _parseAddress(JsonVariantConst json, IPAddress & ip)
 {
-  _fwCommandSchema.clear();
-  _mergeJson(_fwCommandSchema.as<JsonVariant>(), json);
+  if (!json.is<const char *>()) { return false; }
+  return ip.fromString(json.as<const char *>());
 }
 
-OXRS_MQTT * OXRS_Black::getMQTT()
+bool _isValidNetworkConfig(JsonVariantConst json)
 {
-  return &_mqtt;
+  IPAddress ip;
+
+  if (json["mode"] == "dhcp") { return true; }
+  if (json["mode"] != "static") { return false; }
+
+  // Gateway and DNS are optional, but must be valid if supplied
+  if (!_parseAddress(json["ip"], ip)) { return false; }
+  if (!_parseAddress(json["subnet"], ip)) { return false; }
+  if (!json["gateway"].isNull() && !_parseAddress(json["gateway"], ip)) { return false; }
+  if (!json["dns"].isNull() && !_parseAddress(json["dns"], ip)) { return false; }
+
+  return true;
 }
 
-OXRS_API * OXRS_Black::getAPI()
+bool _readNetworkConfig(JsonDocument & json)
 {
-  return &_api;
+  File file = LittleFS.open(NETWORK_FILE, "r");
+  if (!file) { return false; }
+
+  DeserializationError error = deserializeJson(json, file);
+  file.close();
+
+  return !error && _isValidNetworkConfig(json.as<JsonVariantConst>());
 }
 
-OXRS_LCD * OXRS_Black::getLCD()
+bool _beginStatic(byte * mac)
 {
-  return &_screen;
+  JsonDocument json(_policy::jsonAllocator());
+  if (!_readNetworkConfig(json) || json["mode"] != "static") { return false; }
+
+  IPAddress ip, subnet, gateway, dns;
+  _parseAddress(json["ip"], ip);
+  _parseAddress(json["subnet"], subnet);
+
+  // Default to the first address on the subnet for the gateway, and the
+  // gateway for DNS (as the Ethernet library does)
+  if (!_parseAddress(json["gateway"], gateway)) { gateway = IPAddress(ip[0], ip[1], ip[2], 1); }
+  if (!_parseAddress(json["dns"], dns)) { dns = gateway; }
+
+  Ethernet.begin(mac, ip, dns, gateway, subnet);
+  return Ethernet.hardwareStatus() != EthernetNoHardware;
 }
 
-bool OXRS_Black::publishStatus(JsonVariant json)
+bool _discoverLease(byte * mac)
 {
-  // Check for something we can show on the screen
-  if (json.containsKey("index"))
+  // Full DHCP discovery, cached for next time
+  bool success = Ethernet.begin(mac, DHCP_TIMEOUT_MS, DHCP_RESPONSE_TIMEOUT_MS);
+  if (success) { _dhcpLease.save(); }
+  return success;
+}
+
+void _attachNetworkIrq(void)
+{
+  // Bringing up the W5500 resets its interrupt masks, so (re)attach after
+  if (_networkIrqPin < 0) { return; }
+
+  _networkIrq.begin(_networkIrqPin);
+}
+
+void _maintainLease(void)
+{
+  // Leases we reacquired after a restart are ours to renew, since the
+  // Ethernet library only renews leases it acquired itself
+  if (_dhcpLease.active())
   {
-    // Pad the index to 3 chars - to ensure a consistent display for all indices
-    char event[32];
-    sprintf_P(event, PSTR("[%3d]"), json["index"].as<uint8_t>());
+    if (_dhcpLease.loop()) { return; }
 
-    if (json.containsKey("type") && json.containsKey("event"))
-    {
-      if (strcmp(json["type"], json["event"]) == 0)
-      {
-        sprintf_P(event, PSTR("%s %s"), event, json["type"].as<const char *>());
-      }
-      else
-      {
-        sprintf_P(event, PSTR("%s %s %s"), event, json["type"].as<const char *>(), json["event"].as<const char *>());
-      }
-    }
-    else if (json.containsKey("type"))
-    {
-      sprintf_P(event, PSTR("%s %s"), event, json["type"].as<const char *>());
-    }
-    else if (json.containsKey("event"))
-    {
-      sprintf_P(event, PSTR("%s %s"), event, json["event"].as<const char *>());
-    }
+    _logger.println(F("[black] dhcp lease expired"));
 
-    _screen.showEvent(event);
+    byte mac[6];
+    Ethernet.MACAddress(mac);
+    _discoverLease(mac);
+    _attachNetworkIrq();
+    return;
   }
-  
-  // Exit early if no network connection
-  if (!_isNetworkConnected()) { return false; }
 
-  bool success = _mqtt.publishStatus(json);
-  if (success) { _screen.triggerMqttTxLed(); }
-  return success;
+  int state = Ethernet.maintain();
+  if (state == DHCP_CHECK_RENEW_OK || state == DHCP_CHECK_REBIND_OK) { _dhcpLease.save(); }
 }
 
-bool OXRS_Black::publishTelemetry(JsonVariant json)
+bool _checkNetworkHealth(void)
 {
-  // Exit early if no network connection
-  if (!_isNetworkConnected()) { return false; }
+  OXRS_SpiLock lock;
+  return _networkHealth.check();
+}
 
-  bool success = _mqtt.publishTelemetry(json);
-  if (success) { _screen.triggerMqttTxLed(); }
-  return success;
+void _recoverNetwork(void)
+{
+  OXRS_SpiLock lock;
+
+  _logger.print(F("[black] w5500 wedged ("));
+  _logger.print(_networkHealth.getFault());
+  _logger.println(F("), resetting"));
+
+  uint32_t startMs = millis();
+  _networkHealth.recover();
+  _attachNetworkIrq();
+
+  // The reset closed every socket, so drop the MQTT connection (which is
+  // re-established as usual from loop()) and listen for the REST API again
+  _mqttSocket.stop();
+  _server.begin();
+
+  // Check the link (and poll every socket) straight away
+  _linkCheckedMs = millis() - NETWORK_POLL_MS;
+  _networkPolledMs = millis() - NETWORK_POLL_MS;
+
+  _logger.print(F("[black] w5500 recovered in "));
+  _logger.print(millis() - startMs);
+  _logger.println(F("ms"));
 }
 
-size_t OXRS_Black::write(uint8_t character)
+uint8_t _pendingSockets(void)
 {
-  // Pass to logger - allows firmware to use `rack32.println("Log this!")`
-  return _logger.write(character);
+  // Without the interrupt every socket is polled every loop, with it only
+  // sockets with pending events (and every socket each NETWORK_POLL_MS)
+  if (!_networkIrq.enabled()) { return W5500_ALL_SOCKETS; }
+
+  uint8_t sockets = _networkIrq.take();
+  if ((millis() - _networkPolledMs) >= NETWORK_POLL_MS)
+  {
+    _networkPolledMs = millis();
+    sockets = W5500_ALL_SOCKETS;
+  }
+  return sockets;
+}
+
+/* API callbacks */
+void _apiAdopt(JsonVariant json)
+{
+  // Build device adoption info
+  _getFirmwareJson(json);
+  _getSystemJson(json);
+  _getNetworkJson(json);
+  _getConfigSchemaJson(json);
+  _getCommandSchemaJson(json);
+}
+
+void _apiTrace(Request &, Response &res)
+{
+  // Load into chrome://tracing or https://ui.perfetto.dev
+  res.set("Content-Type", "application/json");
+  _trace.print(res);
+}
+
+void _apiMetrics(Request &, Response &res)
+{
+  // Streamed in Prometheus text format, no need to build any json
+  res.set("Content-Type", "text/plain; version=0.0.4");
+  _printMetrics(res);
+}
+
+void _apiGetNetwork(Request &, Response &res)
+{
+  JsonDocument json(_policy::jsonAllocator());
+  if (!_readNetworkConfig(json))
+  {
+    json.clear();
+    json["mode"] = "dhcp";
+  }
+
+  res.set("Content-Type", "application/json");
+  serializeJson(json, res);
+}
+
+void _apiPostNetwork(Request &req, Response &res)
+{
+  JsonDocument json(_policy::jsonAllocator());
+  DeserializationError error = deserializeJson(json, req);
+
+  if (error || !_isValidNetworkConfig(json.as<JsonVariantConst>()))
+  {
+    res.sendStatus(400);
+    return;
+  }
+
+  File file = LittleFS.open(NETWORK_FILE, "w");
+  if (!file)
+  {
+    res.sendStatus(500);
+    return;
+  }
+
+  serializeJson(json, file);
+  file.close();
+
+  _systemCache.fileSystemStale = true;
+
+  // Changing address now would drop every connection, including this one
+  _logger.println(F("[black] network config written to file, restart to apply"));
+  res.sendStatus(204);
+}
+
+/* MQTT callbacks */
+void _mqttConnected() 
+{
+  _metrics.connects++;
+
+  // Start publishing logs to our log topic (the logger keeps a copy)
+  char topic[64];
+  _logger.setTopic(_mqtt.getLogTopic(topic));
+
+  // Start probing the broker round-trip time (if enabled), on a subtopic of
+  // our telemetry topic so it has the configured prefix/suffix like any other
+  char probeTopic[64];
+  _mqtt.getTelemetryTopic(probeTopic);
+  strncat(probeTopic, "/probe", sizeof(probeTopic) - strlen(probeTopic) - 1);
+  _latencyProbe.begin(probeTopic);
+
+  // Publish device adoption info (retained)
+  JsonDocument json(_policy::jsonAllocator());
+  _publishJson(OUTBOUND_REPLY, _mqtt.getAdoptTopic(topic), _api.getAdopt(json.as<JsonVariant>()), true);
+
+  // Log the fact we are now connected
+  _logger.println("[black] mqtt connected");
 }
 
-void OXRS_Black::_initialiseScreen(void)
+void _mqttDisconnected(int state) 
 {
+  int reason = state - MQTT_CONNECTION_TIMEOUT;
+  if (reason >= 0 && reason < (int)DISCONNECT_REASON_COUNT) { _metrics.disconnects[reason]++; }
+
+  // Log the disconnect reason
+  // See https://github.com/knolleary/pubsubclient/blob/2d228f2f862a95846c65a8518c79f48dfc8f188c/src/PubSubClient.h#L44
+  switch (state)
+  {
+    case MQTT_CONNECTION_TIMEOUT:
+      _logger.println(F("[black] mqtt connection timeout"));
+      break;
+    case MQTT_CONNECTION_LOST:
+      _logger.println(F("[black] mqtt connection lost"));
+      break;
+    case MQTT_CONNECT_FAILED:
+      _logger.println(F("[black] mqtt connect failed"));
+      break;
+    case MQTT_DISCONNECTED:
+      _logger.println(F("[black] mqtt disconnected"));
+      break;
+    case MQTT_CONNECT_BAD_PROTOCOL:
+      _logger.println(F("[black] mqtt bad protocol"));
+      break;
+    case MQTT_CONNECT_BAD_CLIENT_ID:
+      _logger.println(F("[black] mqtt bad client id"));
+      break;
+    case MQTT_CONNECT_UNAVAILABLE:
+      _logger.println(F("[black] mqtt unavailable"));
+      break;
+    case MQTT_CONNECT_BAD_CREDENTIALS:
+      _logger.println(F("[black] mqtt bad credentials"));
+      break;      
+    case MQTT_CONNECT_UNAUTHORIZED:
+      _logger.println(F("[black] mqtt unauthorised"));
+      break;      
+  }
+}
+
+void _configActiveBrightness(JsonVariant json)
+{
+  _screen.setBrightnessOn(json.as<int>());
+}
+
+void _configInactiveBrightness(JsonVariant json)
+{
+  _screen.setBrightnessDim(json.as<int>());
+}
+
+void _configActiveDisplay(JsonVariant json)
+{
+  _screen.setOnTimeDisplay(json.as<int>());
+}
+
+void _configEventDisplay(JsonVariant json)
+{
+  _screen.setOnTimeEvent(json.as<int>());
+}
+
+void _configLcdFrameRate(JsonVariant json)
+{
+  _lcdScheduler.setFrameRate(json.as<uint8_t>());
+}
+
+void _configSystemTelemetry(JsonVariant json)
+{
+  _systemTelemetryMs = json.as<uint32_t>() * 1000;
+}
+
+void _configLatencyProbe(JsonVariant json)
+{
+  _latencyProbe.setInterval(json.as<uint32_t>() * 1000);
+}
+
+void _commandRestart(JsonVariant json)
+{
+  if (json.as<bool>())
+  {
+    ESP.restart();
+  }
+}
+
+void _applyConfig(JsonVariant json, bool persist)
+{
+  // Drop (and log) anything which doesn't match the config schema
+  _configValidator.validate(json, _schemaError);
+
+  // Work out what has changed since it was last applied (always done, so
+  // the hashes are up to date if diffing is re-enabled)
+  JsonDocument changes(_policy::jsonAllocator());
+  uint16_t changed = _configDiff.diff(json, changes.to<JsonObject>());
+
+  // Replace the config on file, even if nothing we apply has changed since
+  // keys may have been removed (the file is only re-written if it differs)
+  if (persist)
+  {
+    _config.set(json);
+    _configChangedMs = millis();
+    _configDirty = true;
+  }
+
+  // Only apply the changes, unless the firmware wants full config
+  JsonVariant config = json;
+  if (_configDiffing)
+  {
+    if (changed == 0) { return; }
+    config = changes.as<JsonVariant>();
+  }
+
+  // Dispatch to any keyed handlers (including our LCD config)
+  _configHandlers.dispatch(config);
+
+  // Pass on to the firmware callback
+  if (_onConfig) { _onConfig(config); }
+}
+
+void _mqttConfig(JsonVariant json)
+{
+  _applyConfig(json, true);
+}
+
+void _mqttCommand(JsonVariant json)
+{
+  // Drop (and log) anything which doesn't match the command schema
+  _commandValidator.validate(json, _schemaError);
+
+  // Dispatch to any keyed handlers (including our restart command)
+  _commandHandlers.dispatch(json);
+
+  // Pass on to the firmware callback
+  if (_onCommand) { _onCommand(json); }
+}
+
+void _mqttCallback(char * topic, byte * payload, int length) 
+{
+  OXRS_TraceScope trace(_trace, "mqttCallback");
+
+  // Check for a returning latency probe, which is all ours
+  if (_latencyProbe.receive(topic, payload, length)) { return; }
+
+  // Update screen (on the next frame)
+  if (_policy::lcd) { _lcdScheduler.triggerMqttRxLed(); }
+
+  // Pass down to our MQTT handler and check it was processed ok
+  int state = _mqtt.receive(topic, payload, length);
+  if (state >= 0 && state < (int)RECEIVE_RESULT_COUNT) { _metrics.received[state]++; }
+  switch (state)
+  {
+    case MQTT_RECEIVE_ZERO_LENGTH:
+      _logger.println(F("[black] empty mqtt payload received"));
+      break;
+    case MQTT_RECEIVE_JSON_ERROR:
+      _logger.println(F("[black] failed to deserialise mqtt json payload"));
+      break;
+    case MQTT_RECEIVE_NO_CONFIG_HANDLER:
+      _logger.println(F("[black] no mqtt config handler"));
+      break;
+    case MQTT_RECEIVE_NO_COMMAND_HANDLER:
+      _logger.println(F("[black] no mqtt command handler"));
+      break;
+  }
+}
+
+/* Boot helpers */
+void _bootPhaseStart(uint8_t phase)
+{
+  _bootStats.startMs[phase] = millis() - _bootStats.beginMs;
+}
+
+void _bootPhaseEnd(uint8_t phase)
+{
+  _bootStats.endMs[phase] = millis() - _bootStats.beginMs;
+}
+
+void _bootScreen(void)
+{
+  _bootPhaseStart(BOOT_SCREEN);
+
   // Initialise the LCD
   _screen.begin();
+}
 
-  // Display the firmware and logo (either from SPIFFS or PROGMEM)
-  int returnCode = _screen.drawHeader(FW_SHORT_NAME, FW_MAKER, STRINGIFY(FW_VERSION), "ESP32", _fwLogo);
-  
+void _bootLogo(void)
+{
+#if defined(OXRS_LCD_ENABLE)
+  // Display the firmware and logo (either from the file system or PROGMEM),
+  // done from the loop task since it reads the file system
+  _bootScreenResult = _screen.drawHeader(FW_SHORT_NAME, FW_MAKER, STRINGIFY(FW_VERSION), "ESP32", _fwLogo);
+#endif
+
+  _bootPhaseEnd(BOOT_SCREEN);
+}
+
+void _bootScreenTask(void * parameter)
+{
+  _bootScreen();
+
+  // Let begin() know we are done
+  xTaskNotifyGive((TaskHandle_t)parameter);
+  vTaskDelete(NULL);
+}
+
+void _logScreen(int returnCode)
+{
+#if defined(OXRS_LCD_ENABLE)
   switch (returnCode)
   {
     case LCD_INFO_LOGO_FROM_SPIFFS:
@@ -469,9 +1297,431 @@ void OXRS_Black::_initialiseScreen(void)
       _logger.println(F("[black] no logo found"));
       break;
   }
+#else
+  (void)returnCode;
+#endif
 }
 
-void OXRS_Black::_initialiseNetwork(byte * mac)
+/* LCD task */
+void _lcdTask(void *)
+{
+  for (;;)
+  {
+    {
+      OXRS_TraceScope trace(_trace, "lcd");
+
+      // Push any dirty regions, then let the LCD handle its own timeouts -
+      // the bus is taken per region, so loop() waits at most for one region
+      // to be drawn rather than a whole frame
+      _lcdScheduler.render<OXRS_SpiLock>(_screen);
+
+      OXRS_SpiLock lock;
+      _screen.loop();
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(LCD_TASK_INTERVAL_MS));
+  }
+}
+
+/* Policy helpers */
+OXRS_API * _apiPointer(OXRS_API & api) { return &api; }
+OXRS_API * _apiPointer(OXRS_NullAPI &) { return NULL; }
+
+#if defined(OXRS_LCD_ENABLE)
+OXRS_LCD * _lcdPointer(OXRS_LCD & screen) { return &screen; }
+OXRS_LCD * _lcdPointer(OXRS_NullLCD &) { return NULL; }
+#endif
+
+/* Main program */
+OXRS_Black::OXRS_Black(const uint8_t * fwLogo)
+{
+  _fwLogo = fwLogo;
+}
+
+void OXRS_Black::begin(jsonCallback config, jsonCallback command)
+{
+  // Get our firmware details
+  JsonDocument json(_policy::jsonAllocator());
+  _getFirmwareJson(json.as<JsonVariant>());
+
+  // Log firmware details
+  _logger.print(F("[black] "));
+  serializeJson(json, _logger);
+  _logger.println();
+
+  // Report stack usage for the task running setup()/loop()
+  _trackTask(xTaskGetCurrentTaskHandle());
+
+  // We wrap the callbacks so we can intercept messages intended for the Rack32
+  _onConfig = config;
+  _onCommand = command;
+
+  // Register handlers for our own config/commands
+  _configHandlers.add("systemTelemetrySeconds", _configSystemTelemetry);
+  _configHandlers.add("latencyProbeSeconds", _configLatencyProbe);
+  if (_policy::lcd)
+  {
+    _configHandlers.add("activeBrightnessPercent", _configActiveBrightness);
+    _configHandlers.add("inactiveBrightnessPercent", _configInactiveBrightness);
+    _configHandlers.add("activeDisplaySeconds", _configActiveDisplay);
+    _configHandlers.add("eventDisplaySeconds", _configEventDisplay);
+    _configHandlers.add("lcdFrameRate", _configLcdFrameRate);
+  }
+  _commandHandlers.add("restart", _commandRestart);
+
+  // Compile our schemas so config/commands are validated even if the
+  // firmware doesn't supply any schemas of its own
+  _compileConfigSchema();
+  _compileCommandSchema();
+  
+  // Independent boot steps run in parallel - the LCD is initialised on the
+  // other core while we reset the W5500 and mount the file system, neither
+  // of which need the SPI bus the LCD and W5500 share. The logo is drawn
+  // once we are back in step, so only this task touches the file system.
+  _bootStats.beginMs = millis();
+
+  bool screenTask = false;
+  if (_policy::lcd)
+  {
+    screenTask = xTaskCreatePinnedToCore(_bootScreenTask, "boot", BOOT_TASK_STACK_SIZE, xTaskGetCurrentTaskHandle(), BOOT_TASK_PRIORITY, NULL, BOOT_TASK_CORE) == pdPASS;
+    if (!screenTask) { _bootScreen(); }
+  }
+
+  byte mac[6];
+  _resetNetwork(mac);
+
+  _bootPhaseStart(BOOT_FILE_SYSTEM);
+  LittleFS.begin();
+  _bootPhaseEnd(BOOT_FILE_SYSTEM);
+
+  // Wait for the screen, since persisted config can change it and DHCP
+  // needs the SPI bus
+  if (screenTask) { ulTaskNotifyTake(pdTRUE, portMAX_DELAY); }
+  if (_policy::lcd)
+  {
+    _bootLogo();
+    _logScreen(_bootScreenResult);
+  }
+
+  // Apply any config persisted from last boot, so we don't have to wait
+  // for the network and MQTT broker before behaving as configured
+  _bootPhaseStart(BOOT_CONFIG);
+  _restoreConfig();
+  _bootPhaseEnd(BOOT_CONFIG);
+
+  // Obtain an IP address
+  _bootPhaseStart(BOOT_DHCP);
+  _initialiseNetwork(mac);
+  _bootPhaseEnd(BOOT_DHCP);
+
+  // Set up MQTT (don't attempt to connect yet)
+  _bootPhaseStart(BOOT_MQTT);
+  _initialiseMqtt(mac);
+  _bootPhaseEnd(BOOT_MQTT);
+
+  // Set up the REST API
+  _bootPhaseStart(BOOT_API);
+  _initialiseRestApi();
+  _bootPhaseEnd(BOOT_API);
+
+  // Start drawing the LCD in the background (once nothing else in begin()
+  // needs the SPI bus)
+  if (_policy::lcd && _policy::lcdTask)
+  {
+    TaskHandle_t task;
+    xTaskCreatePinnedToCore(_lcdTask, "lcd", LCD_TASK_STACK_SIZE, NULL, LCD_TASK_PRIORITY, &task, LCD_TASK_CORE);
+    _trackTask(task);
+  }
+
+  // Log how long each phase of our boot took
+  _bootStats.readyMs = millis();
+
+  json.clear();
+  _getBootJson(json.as<JsonVariant>());
+
+  _logger.print(F("[black] "));
+  serializeJson(json, _logger);
+  _logger.println();
+}
+
+void OXRS_Black::loop(void)
+{
+  // Time spent in here vs in the firmware
+  _cpuMeter.loopStart();
+  uint32_t loopStartUs = micros();
+  _trace.begin("loop");
+
+  // Make sure the W5500 hasn't wedged (the link can stay up with no traffic
+  // flowing), resetting it in place if it has
+  if (!_checkNetworkHealth())
+  {
+    _recoverNetwork();
+  }
+
+  // Check our network connection
+  if (_isNetworkConnected())
+  {
+    OXRS_SpiLock lock;
+
+    // Work out which sockets need servicing (all of them unless the W5500
+    // interrupt is wired)
+    uint8_t pending = _pendingSockets();
+    bool poll = pending == W5500_ALL_SOCKETS;
+    uint8_t mqttSocket = _client.getSocketNumber();
+    uint8_t mqttBit = mqttSocket < W5500_SOCKETS ? bit(mqttSocket) : 0;
+
+    // Maintain our DHCP lease
+    if (poll)
+    {
+      _trace.begin("dhcp");
+      _maintainLease();
+      _trace.end("dhcp");
+    }
+    
+    // Handle any MQTT messages
+    if (poll || _mqttBacklog || (pending & mqttBit))
+    {
+      _trace.begin("mqtt");
+      _mqtt.loop();
+      _latencyProbe.loop();
+      _mqttBacklog = _networkIrq.enabled() && _mqttSocket.available() > 0;
+      _trace.end("mqtt");
+    }
+
+    // Publish any queued telemetry and logs (only traced if there are any,
+    // so idle loops don't fill the trace buffer)
+    if (_isOutboundQueued())
+    {
+      _trace.begin("outbound");
+      _outbound.loop(_policy::outboundMessagesPerLoop);
+      _trace.end("outbound");
+    }
+
+    // Send anything published straight through the MQTT client (failures
+    // are counted by the socket wrapper)
+    _mqttSocket.push();
+    
+    // Handle any REST API requests
+    if (_policy::restApi && (poll || (pending & ~mqttBit)))
+    {
+      EthernetClient client = _server.available();
+      if (client)
+      {
+        _trace.begin("api");
+        _apiSocket.setClient(&client);
+        _api.loop(&_apiSocket);
+        _apiSocket.setClient(NULL);
+        _trace.end("api");
+      }
+    }
+  }
+    
+  // Update screen (unless drawn by the LCD task)
+  if (_policy::lcd && !_policy::lcdTask)
+  {
+    _trace.begin("lcd");
+    _lcdScheduler.render<OXRS_SpiLock>(_screen);
+    _screen.loop();
+    _trace.end("lcd");
+  }
+
+  // Publish any batched status events once the window has passed
+  if (_statusBatch.is<JsonArray>() && (millis() - _statusBatchStartMs) >= _statusBatchWindowMs)
+  {
+    _flushStatusBatch();
+  }
+
+  // Track heap low-water marks
+  if ((millis() - _heapStats.sampledMs) >= HEAP_SAMPLE_MS)
+  {
+    _sampleHeap();
+  }
+
+  // Publish system telemetry if enabled
+  _publishSystemTelemetry();
+
+  // Write any config changes to file
+  _persistConfig();
+
+  _trace.end("loop");
+
+  // Keep the trace of any stall for /trace
+  uint32_t loopUs = micros() - loopStartUs;
+  if (loopUs >= TRACE_FREEZE_US) { _trace.freeze(); }
+  _recordLoopDuration(loopUs);
+  _cpuMeter.loopEnd();
+}
+
+void OXRS_Black::setSocketBuffers(uint8_t preset)
+{
+  if (preset > SOCKET_BUFFERS_API_HEAVY) { return; }
+
+  setSocketBuffers(SOCKET_BUFFER_PRESETS[preset][0], SOCKET_BUFFER_PRESETS[preset][1]);
+}
+
+void OXRS_Black::setSocketBuffers(uint16_t mqttBytes, uint16_t apiBytes)
+{
+  _mqttBufferSize = mqttBytes;
+  _apiBufferSize = apiBytes;
+}
+
+void OXRS_Black::setNetworkInterrupt(uint8_t pin)
+{
+  _networkIrqPin = pin;
+}
+
+void OXRS_Black::setConfigSchema(JsonVariant json)
+{
+  _fwConfigSchema.clear();
+  _mergeJson(_fwConfigSchema.as<JsonVariant>(), json);
+
+  _compileConfigSchema();
+}
+
+void OXRS_Black::setCommandSchema(JsonVariant json)
+{
+  _fwCommandSchema.clear();
+  _mergeJson(_fwCommandSchema.as<JsonVariant>(), json);
+
+  _compileCommandSchema();
+}
+
+bool OXRS_Black::onConfig(const char * key, jsonCallback handler)
+{
+  return _configHandlers.add(key, handler);
+}
+
+bool OXRS_Black::onConfig(const char * key, indexedJsonCallback handler)
+{
+  return _configHandlers.add(key, handler);
+}
+
+bool OXRS_Black::onCommand(const char * key, jsonCallback handler)
+{
+  return _commandHandlers.add(key, handler);
+}
+
+bool OXRS_Black::onCommand(const char * key, indexedJsonCallback handler)
+{
+  return _commandHandlers.add(key, handler);
+}
+
+void OXRS_Black::setConfigDiffing(bool enabled)
+{
+  _configDiffing = enabled;
+}
+
+OXRS_MQTT * OXRS_Black::getMQTT()
+{
+  return &_mqtt;
+}
+
+OXRS_Outbound * OXRS_Black::getOutbound()
+{
+  return &_outbound;
+}
+
+OXRS_API * OXRS_Black::getAPI()
+{
+  return _apiPointer(_api);
+}
+
+#if defined(OXRS_LCD_ENABLE)
+OXRS_LCD * OXRS_Black::getLCD()
+{
+  return _lcdPointer(_screen);
+}
+#endif
+
+bool OXRS_Black::publishStatus(JsonVariant json)
+{
+  // Check for something we can show on the screen
+  char event[LCD_EVENT_SIZE];
+  bool hasEvent = _policy::lcd && _formatEvent(json, event);
+
+  // Queue the status if batching, the screen only shows the latest
+  // event from each batch when it is published
+  if (_statusBatchWindowMs > 0 && _isNetworkConnected() && _isMqttConnected())
+  {
+    if (hasEvent) { strcpy(_statusBatchEvent, event); }
+
+    if (!_statusBatch.is<JsonArray>())
+    {
+      _statusBatch.to<JsonArray>();
+      _statusBatchStartMs = millis();
+    }
+
+    if (!_statusBatch.add(json)) { return false; }
+
+    // Publish immediately once the batch is full
+    if (_statusBatch.size() >= _statusBatchMaxEvents)
+    {
+      return _flushStatusBatch();
+    }
+
+    return true;
+  }
+
+  if (hasEvent) { _lcdScheduler.showEvent(event); }
+  
+  // Exit early if no network connection
+  if (!_isNetworkConnected()) { return false; }
+
+  char topic[64];
+  bool success = _publishJson(OUTBOUND_STATUS, _mqtt.getStatusTopic(topic), json, false);
+  if (_policy::lcd && success) { _lcdScheduler.triggerMqttTxLed(); }
+  return success;
+}
+
+void OXRS_Black::setSystemTelemetry(uint32_t intervalSeconds)
+{
+  _systemTelemetryMs = intervalSeconds * 1000;
+}
+
+void OXRS_Black::setLatencyProbe(uint32_t intervalSeconds)
+{
+  _latencyProbe.setInterval(intervalSeconds * 1000);
+}
+
+void OXRS_Black::setCpuMetering(bool enabled)
+{
+  if (enabled)
+  {
+    _cpuMeter.begin();
+  }
+  else
+  {
+    _cpuMeter.end();
+  }
+}
+
+void OXRS_Black::setStatusBatching(uint16_t windowMs, uint8_t maxEvents)
+{
+  // Publish anything queued under the old settings
+  _flushStatusBatch();
+
+  _statusBatchWindowMs = windowMs;
+  _statusBatchMaxEvents = maxEvents > 0 ? maxEvents : 1;
+}
+
+bool OXRS_Black::publishTelemetry(JsonVariant json)
+{
+  // Exit early if no network connection
+  if (!_isNetworkConnected()) { return false; }
+
+  char topic[64];
+  bool success = _publishJson(OUTBOUND_TELEMETRY, _mqtt.getTelemetryTopic(topic), json, false);
+  if (_policy::lcd && success) { _lcdScheduler.triggerMqttTxLed(); }
+  return success;
+}
+
+size_t OXRS_Black::write(uint8_t character)
+{
+  // Pass to logger - allows firmware to use `rack32.println("Log this!")`
+  return _logger.write(character);
+}
+
+void OXRS_Black::_resetNetwork(byte * mac)
 {
   // Get WiFi base MAC address
   WiFi.macAddress(mac);
@@ -491,6 +1741,7 @@ void OXRS_Black::_initialiseNetwork(byte * mac)
   Ethernet.init(ETHERNET_CS_PIN);
 
   // Reset Wiznet W5500
+  _bootPhaseStart(BOOT_WIZNET_RESET);
   pinMode(WIZNET_RESET_PIN, OUTPUT);
   digitalWrite(WIZNET_RESET_PIN, HIGH);
   delay(250);
@@ -498,12 +1749,49 @@ void OXRS_Black::_initialiseNetwork(byte * mac)
   delay(50);
   digitalWrite(WIZNET_RESET_PIN, HIGH);
   delay(350);
+  _bootPhaseEnd(BOOT_WIZNET_RESET);
+}
 
-  // Connect ethernet and get an IP address via DHCP
-  bool success = Ethernet.begin(mac, DHCP_TIMEOUT_MS, DHCP_RESPONSE_TIMEOUT_MS);
+void OXRS_Black::_initialiseNetwork(byte * mac)
+{
+  // Connect ethernet using static settings from file if there are any,
+  // otherwise get an IP address via DHCP, reacquiring our lease from before
+  // a restart if we can (skipping full discovery)
+  _bootStats.firstNetworkMs = millis();
+
+  // Size the socket buffers
+  _mqttSocket.setBufferSize(_mqttBufferSize);
+  _mqttSocket.setReadBufferSize(SOCKET_READ_BUFFER_SIZE);
+  if (_policy::restApi)
+  {
+    _apiSocket.setBufferSize(_apiBufferSize);
+    _apiSocket.setReadBufferSize(SOCKET_READ_BUFFER_SIZE);
+  }
+
+  bool success = _beginStatic(mac);
+  if (success)
+  {
+    _logger.println(F("[black] static ip config applied"));
+  }
+  else if ((success = _dhcpLease.reboot(mac)))
+  {
+    _logger.println(F("[black] dhcp lease reacquired"));
+  }
+  else
+  {
+    success = _discoverLease(mac);
+  }
   
   _logger.print(F("[black] ip address: "));
   _logger.println(success ? Ethernet.localIP() : IPAddress(0, 0, 0, 0));
+
+  _attachNetworkIrq();
+
+  // Nothing to monitor if there is no W5500
+  if (Ethernet.hardwareStatus() != EthernetNoHardware)
+  {
+    _networkHealth.begin(WIZNET_RESET_PIN);
+  }
 }
 
 void OXRS_Black::_initialiseMqtt(byte * mac)
@@ -517,6 +1805,7 @@ void OXRS_Black::_initialiseMqtt(byte * mac)
   _mqtt.setClientId(clientId);
   
   // Register our callbacks
+  _outbound.onSend(_sendMqttSocket);
   _mqtt.onConnected(_mqttConnected);
   _mqtt.onDisconnected(_mqttDisconnected);
   _mqtt.onConfig(_mqttConfig);
@@ -537,12 +1826,136 @@ void OXRS_Black::_initialiseRestApi(void)
   
   // Register our callbacks
   _api.onAdopt(_apiAdopt);
+  _api.get("/metrics", &_apiMetrics);
+  _api.get("/trace", &_apiTrace);
+  _api.get("/network", &_apiGetNetwork);
+  _api.post("/network", &_apiPostNetwork);
 
   // Start listening
   _server.begin();
 }
 
+bool OXRS_Black::_flushStatusBatch(void)
+{
+  if (!_statusBatch.is<JsonArray>()) { return true; }
+
+  // Show the latest event from this batch
+  if (_policy::lcd && _statusBatchEvent[0])
+  {
+    _lcdScheduler.showEvent(_statusBatchEvent);
+    _statusBatchEvent[0] = 0;
+  }
+
+  char topic[64];
+  bool success = _isNetworkConnected() && _publishJson(OUTBOUND_STATUS, _mqtt.getStatusTopic(topic), _statusBatch.as<JsonVariant>(), false);
+  if (_policy::lcd && success) { _lcdScheduler.triggerMqttTxLed(); }
+
+  _statusBatch.clear();
+  return success;
+}
+
+void OXRS_Black::_publishSystemTelemetry(void)
+{
+  if (_systemTelemetryMs == 0) { return; }
+  if ((millis() - _systemTelemetryLastMs) < _systemTelemetryMs) { return; }
+
+  _systemTelemetryLastMs = millis();
+
+  JsonDocument json(_policy::jsonAllocator());
+  _getSystemJson(json.as<JsonVariant>());
+  publishTelemetry(json.as<JsonVariant>());
+}
+
+void OXRS_Black::_restoreConfig(void)
+{
+  // Will already be mounted during boot (unless that failed)
+  if (!LittleFS.begin()) { return; }
+
+  File file = LittleFS.open(CONFIG_FILE, "r");
+  if (!file) { return; }
+
+  DeserializationError error = deserializeJson(_config, file);
+  file.close();
+
+  if (error || !_config.is<JsonObject>())
+  {
+    _logger.println(F("[black] failed to restore config from file"));
+    _config.clear();
+    return;
+  }
+
+  // Remember what is on file so unchanged config is never re-written
+  OXRS_HashPrint hash;
+  serializeJson(_config, hash);
+  _configFileHash = hash.hash;
+
+  // Apply a copy, since validation can remove keys
+  JsonDocument json(_policy::jsonAllocator());
+  json.set(_config);
+  _applyConfig(json.as<JsonVariant>(), false);
+
+  _logger.println(F("[black] config restored from file"));
+}
+
+void OXRS_Black::_persistConfig(void)
+{
+  if (!_configDirty) { return; }
+
+  // Wait for bursts of config to settle, and limit flash wear
+  uint32_t now = millis();
+  if ((now - _configChangedMs) < CONFIG_WRITE_DELAY_MS) { return; }
+  if (_configWritten && (now - _configWrittenMs) < CONFIG_WRITE_INTERVAL_MS) { return; }
+  if (_configFailed && (now - _configFailedMs) < CONFIG_WRITE_INTERVAL_MS) { return; }
+
+  OXRS_HashPrint hash;
+  serializeJson(_config, hash);
+  if (hash.hash == _configFileHash)
+  {
+    _configDirty = false;
+    return;
+  }
+
+  // Write to a temp file first so a power loss can't leave a partial config,
+  // LittleFS renames are atomic, replacing any existing file
+  bool written = false;
+  File file = LittleFS.open(CONFIG_TEMP_FILE, "w");
+  if (file)
+  {
+    written = serializeJson(_config, file) == measureJson(_config);
+    file.close();
+
+    written = written && LittleFS.rename(CONFIG_TEMP_FILE, CONFIG_FILE);
+    if (!written) { LittleFS.remove(CONFIG_TEMP_FILE); }
+  }
+
+  // Leave the config dirty so the write is retried
+  if (!written)
+  {
+    _configFailedMs = now;
+    _configFailed = true;
+    _logger.println(F("[black] failed to write config to file"));
+    return;
+  }
+
+  _configDirty = false;
+  _configFailed = false;
+  _configFileHash = hash.hash;
+  _configWrittenMs = now;
+  _systemCache.fileSystemStale = true;
+  _configWritten = true;
+
+  _logger.println(F("[black] config written to file"));
+}
+
 bool OXRS_Black::_isNetworkConnected(void)
 {
-  return Ethernet.linkStatus() == LinkON;
-}
\ No newline at end of file
+  // With the W5500 interrupt wired the link is only checked periodically
+  if (!_networkIrq.enabled() || (millis() - _linkCheckedMs) >= NETWORK_POLL_MS)
+  {
+    OXRS_SpiLock lock;
+    _linkUp = Ethernet.linkStatus() == LinkON;
+    _linkCheckedMs = millis();
+  }
+
+  return _linkUp;
+}
@@ -7,10 +7,17 @@
 
 #include <OXRS_MQTT.h>                // For MQTT pub/sub
 #include <OXRS_API.h>                 // For REST API
-#include <OXRS_LCD.h>                 // For LCD runtime displays
+#include "OXRS_HandlerRegistry.h"     // For keyed config/command handlers
+#include "OXRS_Outbound.h"            // For prioritised outbound MQTT traffic
 
-// LCD screen
+// LCD screen (build with OXRS_LCD_DISABLE defined for headless units)
+#if !defined(OXRS_LCD_DISABLE)
 #define       OXRS_LCD_ENABLE
+#endif
+
+#if defined(OXRS_LCD_ENABLE)
+#include <OXRS_LCD.h>                 // For LCD runtime displays
+#endif
 
 // Ethernet
 #define       ETHERNET_CS_PIN             5
@@ -18,48 +25,168 @@
 #define       DHCP_TIMEOUT_MS             15000
 #define       DHCP_RESPONSE_TIMEOUT_MS    4000
 
+// Static IP settings (if any), set via the REST API and applied at boot
+#define       NETWORK_FILE                "/network.json"
+
+// Boot (the LCD is initialised on another core while we reset the W5500,
+// the logo is drawn afterwards from the loop task)
+#define       BOOT_TASK_STACK_SIZE        4096
+#define       BOOT_TASK_PRIORITY          1
+#define       BOOT_TASK_CORE              0
+
 // I2C
 #define       I2C_SDA                     21
 #define       I2C_SCL                     22
 
+// W5500 interrupt (if wired, see setNetworkInterrupt()), sockets are then
+// only serviced when they have pending events - everything is still polled
+// (and the link checked) this often, to keep MQTT alive and renew our lease
+#define       NETWORK_POLL_MS             1000
+
 // REST API
 #define       REST_API_PORT               80
 
+// Socket write buffer presets (see setSocketBuffers(), off by default) - the
+// W5500 driver gives every socket a fixed 2KB, so these size the buffers we
+// coalesce small writes into before handing them to the W5500 as a single
+// send. They are starting points, not measured optima.
+#define       SOCKET_BUFFERS_BALANCED     0
+#define       SOCKET_BUFFERS_MQTT_HEAVY   1
+#define       SOCKET_BUFFERS_API_HEAVY    2
+
+// Socket reads are done in bursts of up to this many bytes (MQTT and the
+// REST API parse byte-at-a-time, which would otherwise cost a W5500 receive
+// per byte)
+#define       SOCKET_READ_BUFFER_SIZE     256
+
+// Background LCD task (if enabled by the policy), runs at low priority on
+// the core not running loop() and shares the SPI bus with the W5500
+#define       LCD_TASK_STACK_SIZE         4096
+#define       LCD_TASK_PRIORITY           1
+#define       LCD_TASK_CORE               0
+#define       LCD_TASK_INTERVAL_MS        10
+
+// Outbound MQTT traffic (status and replies are published immediately,
+// queued telemetry and logs are published from loop())
+#define       OUTBOUND_MESSAGES_PER_LOOP  4
+
+// System telemetry (expensive fields are cached, and file system usage
+// only refreshed periodically or when we write to the file system)
+#define       FS_USAGE_REFRESH_MS         600000
+
+// Heap low-water marks are sampled from loop(), stack high-water marks
+// are reported for the loop task and any tasks the library creates
+#define       HEAP_SAMPLE_MS              1000
+#define       MAX_TRACKED_TASKS           4
+
+// Loop duration histogram buckets (upper bounds in microseconds) for /metrics
+#define       LOOP_HISTOGRAM_BUCKETS      10
+
+// A loop taking longer than this freezes the trace buffer, so /trace shows
+// the stall rather than the idle loops since (recording resumes once dumped)
+#define       TRACE_FREEZE_US             50000
+
+// Config persistence (bursts of config are coalesced into a single write,
+// and the file is never re-written more often than the write interval)
+#define       CONFIG_FILE                 "/config.json"
+#define       CONFIG_TEMP_FILE            "/config.tmp"
+#define       CONFIG_WRITE_DELAY_MS       5000
+#define       CONFIG_WRITE_INTERVAL_MS    60000
+
+// Compile-time feature selection (defaults use the settings above)
+#include "OXRS_Black_Policy.h"
+
+// NOTE: the library drives singleton hardware (W5500, LCD) so is built for
+//       a single policy, OXRS_BLACK_POLICY - see OXRS_Black_Policy.h
 class OXRS_Black : public Print
 {
   public:
     OXRS_Black(const uint8_t * fwLogo = NULL);
 
+    // NOTE: any config persisted from a previous boot is applied during begin()
+    //       so config handlers must be registered beforehand
     void begin(jsonCallback config, jsonCallback command);
     void loop(void);
 
-    // Firmware can define the config/commands it supports - for device discovery and adoption
+    // Firmware can define the config/commands it supports - for device discovery and adoption,
+    // and to validate incoming config/commands before they are passed to the firmware callbacks
     void setConfigSchema(JsonVariant json);
     void setCommandSchema(JsonVariant json);
 
+    // Firmware can register handlers for individual config/command keys, which are
+    // dispatched in a single pass over each payload (before the begin() callbacks).
+    // Indexed handlers are called for each element of an array of objects,
+    // e.g. {"inputs": [{"index": 1, ...}, {"index": 2, ...}]}
+    bool onConfig(const char * key, jsonCallback handler);
+    bool onConfig(const char * key, indexedJsonCallback handler);
+    bool onCommand(const char * key, jsonCallback handler);
+    bool onCommand(const char * key, indexedJsonCallback handler);
+
+    // Retained config is redelivered on every reconnect, so by default only keys that
+    // have changed since they were last applied are passed on - disable this to force
+    // every config payload to be applied in full
+    void setConfigDiffing(bool enabled);
+
     // Return a pointer to the MQTT library
     OXRS_MQTT * getMQTT(void);
 
-    // Return a pointer to the API library
+    // Return a pointer to the outbound scheduler (e.g. for per-class stats)
+    OXRS_Outbound * getOutbound(void);
+
+    // Return a pointer to the API library (NULL if disabled by the policy)
     OXRS_API * getAPI(void);
 
+#if defined(OXRS_LCD_ENABLE)
     // Return a pointer to the LCD so firmware can customise if required
-    // Should be called after .begin()
+    // Should be called after .begin() (NULL if disabled by the policy)
     OXRS_LCD * getLCD(void);
+#endif
     
     // Helpers for publishing to stat/ and tele/ topics
     bool publishStatus(JsonVariant json);
     bool publishTelemetry(JsonVariant json);
 
+    // Publish the system block (heap, flash, file system) to tele/ every
+    // intervalSeconds from loop() (0 disables, also configurable via MQTT)
+    void setSystemTelemetry(uint32_t intervalSeconds);
+
+    // Measure the round-trip time to the MQTT broker every intervalSeconds, by
+    // echoing a probe off a device-private topic (0 disables, also configurable
+    // via MQTT) - p50/p99 RTT are reported in system telemetry
+    void setLatencyProbe(uint32_t intervalSeconds);
+
+    // Measure per-core CPU utilisation for system telemetry (off by default,
+    // since the idle tasks then spin instead of sleeping, costing power)
+    void setCpuMetering(bool enabled);
+
+    // Coalesce status events into a single array payload, published once the
+    // first event is windowMs old or maxEvents are queued (windowMs of 0 disables)
+    void setStatusBatching(uint16_t windowMs, uint8_t maxEvents);
+
+    // Buffer writes to the MQTT and REST API sockets, from a preset or in bytes
+    // (0, the default, disables buffering) - must be called before begin(), see
+    // /metrics for the number of sends vs bytes sent on each socket. Anything
+    // published directly via getMQTT() is then only sent on the next loop().
+    void setSocketBuffers(uint8_t preset);
+    void setSocketBuffers(uint16_t mqttBytes, uint16_t apiBytes);
+
+    // Wire the W5500 INT pin to service sockets only when they have pending
+    // events, instead of polling them every loop (call before begin())
+    void setNetworkInterrupt(uint8_t pin);
+
     // Implement Print.h wrapper
     virtual size_t write(uint8_t);
     using Print::write;
 
   private:
-    void _initialiseScreen(void);
+    void _resetNetwork(byte * mac);
     void _initialiseNetwork(byte * mac);
     void _initialiseMqtt(byte * mac);
     void _initialiseRestApi(void);
+    void _restoreConfig(void);
+    void _persistConfig(void);
+    bool _flushStatusBatch(void);
+    void _publishSystemTelemetry(void);
     
     bool _isNetworkConnected(void);
 };
@@ -0,0 +1,83 @@
+/*
+ * OXRS_Black_Policy.h
+ */
+
+#ifndef OXRS_Black_Policy_H
+#define OXRS_Black_Policy_H
+
+#include <ArduinoJson.h>
+#include "OXRS_Outbound.h"
+#include "OXRS_Trace.h"
+
+// Logger backend which only logs to serial, i.e. no log traffic on MQTT
+class OXRS_SerialLogger : public Print
+{
+  public:
+    OXRS_SerialLogger(OXRS_Outbound &, PubSubClient &) {}
+
+    void setTopic(const char *) {}
+
+    virtual size_t write(uint8_t character) { return Serial.write(character); }
+    using Print::write;
+};
+
+// Default allocator for the JsonDocuments the library creates (the heap)
+class OXRS_JsonHeapAllocator : public ArduinoJson::Allocator
+{
+  public:
+    void * allocate(size_t size) override { return malloc(size); }
+    void deallocate(void * pointer) override { free(pointer); }
+    void * reallocate(void * pointer, size_t size) override { return realloc(pointer, size); }
+
+    static ArduinoJson::Allocator * instance(void)
+    {
+      static OXRS_JsonHeapAllocator allocator;
+      return &allocator;
+    }
+};
+
+// Compile-time feature selection. Subsystems a policy disables are replaced
+// by empty stand-ins, so every call into them compiles away.
+//
+// Firmware can supply its own policy (a struct with the same members) with
+// build flags, e.g.
+//   -DOXRS_BLACK_POLICY_HEADER='"MyPolicy.h"' -DOXRS_BLACK_POLICY=MyPolicy
+//
+// NOTE: without the REST API the MQTT broker config is not loaded from file,
+//       so must be set by the firmware via getMQTT() before begin()
+struct OXRS_BlackDefaultPolicy
+{
+  // LCD screen (can only be enabled if built without OXRS_LCD_DISABLE)
+#if defined(OXRS_LCD_ENABLE)
+  static const bool lcd = true;
+#else
+  static const bool lcd = false;
+#endif
+
+  // Draw the LCD from a background task, rather than from loop()
+  static const bool lcdTask = false;
+
+  // REST API (adoption, /metrics and /trace)
+  static const bool restApi = true;
+
+  // Logger backend, constructed with (OXRS_Outbound &, PubSubClient &)
+  typedef OXRS_OutboundLogger Logger;
+
+  // Queue and buffer sizes
+  static const uint8_t outboundQueueSize = OUTBOUND_QUEUE_SIZE;
+  static const uint8_t outboundMessagesPerLoop = OUTBOUND_MESSAGES_PER_LOOP;
+  static const uint16_t traceBufferSize = TRACE_BUFFER_SIZE;
+
+  // Allocator for every JsonDocument the library creates (e.g. to use PSRAM)
+  static ArduinoJson::Allocator * jsonAllocator(void) { return OXRS_JsonHeapAllocator::instance(); }
+};
+
+#if defined(OXRS_BLACK_POLICY_HEADER)
+#include OXRS_BLACK_POLICY_HEADER
+#endif
+
+#if !defined(OXRS_BLACK_POLICY)
+#define       OXRS_BLACK_POLICY           OXRS_BlackDefaultPolicy
+#endif
+
+#endif
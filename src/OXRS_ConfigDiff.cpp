@@ -0,0 +1,102 @@
+/*
+ * OXRS_ConfigDiff.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_ConfigDiff.h"
+#include "OXRS_Hash.h"
+
+// Index of an entry that isn't part of an indexed array
+#define       NO_INDEX                    -1
+
+static bool _isIndexedArray(JsonVariantConst value)
+{
+  if (!value.is<JsonArrayConst>()) { return false; }
+
+  for (JsonVariantConst item : value.as<JsonArrayConst>())
+  {
+    if (!item["index"].is<uint8_t>()) { return false; }
+  }
+
+  return value.size() > 0;
+}
+
+OXRS_ConfigDiff::OXRS_ConfigDiff() : _entries(CONFIG_DIFF_SIZE)
+{
+}
+
+OXRS_ConfigDiff::~OXRS_ConfigDiff()
+{
+  _entries.each([](_entry & entry) { free(entry.key); });
+}
+
+uint16_t OXRS_ConfigDiff::diff(JsonVariantConst json, JsonObject changes)
+{
+  if (!json.is<JsonObjectConst>()) { return 0; }
+
+  uint16_t changed = 0;
+  for (JsonPairConst kvp : json.as<JsonObjectConst>())
+  {
+    if (_isIndexedArray(kvp.value()))
+    {
+      JsonArray items;
+      for (JsonVariantConst item : kvp.value().as<JsonArrayConst>())
+      {
+        if (!_update(kvp.key().c_str(), item["index"].as<uint8_t>(), item)) { continue; }
+
+        if (items.isNull()) { items = changes[kvp.key()].to<JsonArray>(); }
+        items.add(item);
+        changed++;
+      }
+    }
+    else if (_update(kvp.key().c_str(), NO_INDEX, kvp.value()))
+    {
+      changes[kvp.key()] = kvp.value();
+      changed++;
+    }
+  }
+
+  return changed;
+}
+
+uint32_t OXRS_ConfigDiff::_hashEntry(const char * key, int16_t index)
+{
+  uint32_t hash = oxrsHash(key);
+  if (index != NO_INDEX) { hash = (hash ^ (index + 1)) * OXRS_HASH_PRIME; }
+  return _table::slotHash(hash);
+}
+
+bool OXRS_ConfigDiff::_update(const char * key, int16_t index, JsonVariantConst value)
+{
+  OXRS_HashPrint hash;
+  serializeJson(value, hash);
+
+  // Hashes can collide, so confirm the key (and index) itself
+  uint32_t entryHash = _hashEntry(key, index);
+  _entry * entry = _entries.find(entryHash, [key, index](const _entry & slot) { return slot.index == index && strcmp(slot.key, key) == 0; });
+
+  if (entry)
+  {
+    if (entry->valueHash == hash.hash) { return false; }
+
+    entry->valueHash = hash.hash;
+    return true;
+  }
+
+  // New key, if we can't store it then treat it as changed rather than
+  // lose config
+  char * copy = strdup(key);
+  if (!copy) { return true; }
+
+  entry = _entries.insert(entryHash);
+  if (!entry)
+  {
+    free(copy);
+    return true;
+  }
+
+  entry->key = copy;
+  entry->index = index;
+  entry->valueHash = hash.hash;
+  return true;
+}
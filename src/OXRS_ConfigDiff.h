@@ -0,0 +1,43 @@
+/*
+ * OXRS_ConfigDiff.h
+ */
+
+#ifndef OXRS_ConfigDiff_H
+#define OXRS_ConfigDiff_H
+
+#include <ArduinoJson.h>
+#include "OXRS_HashTable.h"
+
+// Initial table size (must be a power of 2), grows as keys are seen
+#define       CONFIG_DIFF_SIZE            32
+
+class OXRS_ConfigDiff
+{
+  public:
+    OXRS_ConfigDiff();
+    ~OXRS_ConfigDiff();
+
+    // Copy any keys whose value has changed since they were last seen into
+    // changes, and remember the new values - returns the number of changes.
+    // Arrays of indexed objects are diffed per element, so only the changed
+    // channels are copied, e.g. {"inputs": [{"index": 3, ...}]}
+    uint16_t diff(JsonVariantConst json, JsonObject changes);
+
+  private:
+    // Elements of an indexed array are keyed on their parent key + index
+    struct _entry
+    {
+      uint32_t hash;
+      char * key;
+      int16_t index;
+      uint32_t valueHash;
+    };
+
+    typedef OXRS_HashTable<_entry> _table;
+    _table _entries;
+
+    static uint32_t _hashEntry(const char * key, int16_t index);
+    bool _update(const char * key, int16_t index, JsonVariantConst value);
+};
+
+#endif
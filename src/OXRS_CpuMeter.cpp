@@ -0,0 +1,137 @@
+/*
+ * OXRS_CpuMeter.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_CpuMeter.h"
+
+#include <esp_freertos_hooks.h>       // For idle hooks
+#include <esp_timer.h>                // For esp_timer_get_time()
+
+// Idle time accumulated by the idle hooks (free running, only ever
+// written by the idle task on that core)
+static volatile uint32_t _idleUs[portNUM_PROCESSORS];
+static uint32_t _idleCallUs[portNUM_PROCESSORS];
+
+static inline void IRAM_ATTR _idle(uint8_t core)
+{
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  uint32_t gap = now - _idleCallUs[core];
+  if (gap < CPU_IDLE_GAP_US) { _idleUs[core] += gap; }
+  _idleCallUs[core] = now;
+}
+
+// Returning false keeps the idle task spinning (rather than waiting for
+// an interrupt) so consecutive calls measure the time spent idle
+static bool IRAM_ATTR _idleHook0(void) { _idle(0); return false; }
+#if portNUM_PROCESSORS > 1
+static bool IRAM_ATTR _idleHook1(void) { _idle(1); return false; }
+#endif
+
+OXRS_CpuMeter::OXRS_CpuMeter()
+{
+  _enabled = false;
+  _windowStartUs = 0;
+  _loopStartUs = 0;
+  _loopEndUs = 0;
+  _libraryUs = 0;
+  _firmwareUs = 0;
+  _libraryPercent = 0;
+  _firmwarePercent = 0;
+
+  for (uint8_t i = 0; i < portNUM_PROCESSORS; i++)
+  {
+    _idleStartUs[i] = 0;
+    _corePercent[i] = 0;
+  }
+}
+
+void OXRS_CpuMeter::begin(void)
+{
+  if (_enabled) { return; }
+
+  esp_register_freertos_idle_hook_for_cpu(_idleHook0, 0);
+#if portNUM_PROCESSORS > 1
+  esp_register_freertos_idle_hook_for_cpu(_idleHook1, 1);
+#endif
+
+  // Start a new window, so it doesn't include time before the hooks ran
+  _windowStartUs = micros();
+  _libraryUs = 0;
+  _firmwareUs = 0;
+  for (uint8_t i = 0; i < portNUM_PROCESSORS; i++)
+  {
+    _idleStartUs[i] = _idleUs[i];
+  }
+
+  _enabled = true;
+}
+
+void OXRS_CpuMeter::end(void)
+{
+  if (!_enabled) { return; }
+
+  esp_deregister_freertos_idle_hook_for_cpu(_idleHook0, 0);
+#if portNUM_PROCESSORS > 1
+  esp_deregister_freertos_idle_hook_for_cpu(_idleHook1, 1);
+#endif
+
+  _enabled = false;
+}
+
+void OXRS_CpuMeter::loopStart(void)
+{
+  uint32_t now = micros();
+
+  // Time since we last returned was spent in the firmware
+  if (_loopEndUs) { _firmwareUs += now - _loopEndUs; }
+  _loopStartUs = now;
+
+  if (!_windowStartUs) { _windowStartUs = now; }
+  if ((now - _windowStartUs) >= (CPU_SAMPLE_MS * 1000UL))
+  {
+    _sample(now);
+  }
+}
+
+void OXRS_CpuMeter::loopEnd(void)
+{
+  _loopEndUs = micros();
+  _libraryUs += _loopEndUs - _loopStartUs;
+}
+
+void OXRS_CpuMeter::getJson(JsonVariant json)
+{
+  JsonObject cpu = json["cpu"].to<JsonObject>();
+
+  for (uint8_t i = 0; _enabled && i < portNUM_PROCESSORS; i++)
+  {
+    char key[16];
+    sprintf_P(key, PSTR("core%dPercent"), i);
+    cpu[key] = _corePercent[i];
+  }
+
+  cpu["loopLibraryPercent"] = _libraryPercent;
+  cpu["loopFirmwarePercent"] = _firmwarePercent;
+}
+
+void OXRS_CpuMeter::_sample(uint32_t now)
+{
+  uint32_t windowUs = now - _windowStartUs;
+
+  for (uint8_t i = 0; _enabled && i < portNUM_PROCESSORS; i++)
+  {
+    uint32_t idleUs = _idleUs[i] - _idleStartUs[i];
+    _idleStartUs[i] += idleUs;
+
+    if (idleUs > windowUs) { idleUs = windowUs; }
+    _corePercent[i] = 100 - (uint8_t)(((uint64_t)idleUs * 100) / windowUs);
+  }
+
+  _libraryPercent = ((uint64_t)_libraryUs * 100) / windowUs;
+  _firmwarePercent = ((uint64_t)_firmwareUs * 100) / windowUs;
+
+  _libraryUs = 0;
+  _firmwareUs = 0;
+  _windowStartUs = now;
+}
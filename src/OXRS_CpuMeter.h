@@ -0,0 +1,54 @@
+/*
+ * OXRS_CpuMeter.h
+ */
+
+#ifndef OXRS_CpuMeter_H
+#define OXRS_CpuMeter_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Utilisation is averaged over this window
+#define       CPU_SAMPLE_MS               1000
+
+// Gaps between idle hook calls shorter than this are counted as idle
+// time, anything longer means another task (or ISR) had the core
+#define       CPU_IDLE_GAP_US             20
+
+class OXRS_CpuMeter
+{
+  public:
+    OXRS_CpuMeter();
+
+    // Register/remove the idle hooks on both cores - while registered the
+    // idle tasks spin rather than wait for an interrupt (costing power), so
+    // per-core utilisation is opt-in. The loop split is always measured.
+    void begin(void);
+    void end(void);
+
+    // Bracket OXRS_Black::loop() so we can split the loop task time
+    // between the library and the firmware
+    void loopStart(void);
+    void loopEnd(void);
+
+    // Per-core utilisation and library/firmware share of the loop task
+    void getJson(JsonVariant json);
+
+  private:
+    bool _enabled;
+    uint32_t _windowStartUs;
+    uint32_t _idleStartUs[portNUM_PROCESSORS];
+
+    uint32_t _loopStartUs;
+    uint32_t _loopEndUs;
+    uint32_t _libraryUs;
+    uint32_t _firmwareUs;
+
+    uint8_t _corePercent[portNUM_PROCESSORS];
+    uint8_t _libraryPercent;
+    uint8_t _firmwarePercent;
+
+    void _sample(uint32_t now);
+};
+
+#endif
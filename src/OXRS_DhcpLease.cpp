@@ -0,0 +1,337 @@
+/*
+ * OXRS_DhcpLease.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_DhcpLease.h"
+#include "OXRS_Hash.h"
+
+// See https://www.rfc-editor.org/rfc/rfc2131 and rfc2132
+#define       DHCP_SERVER_PORT            67
+#define       DHCP_CLIENT_PORT            68
+
+#define       DHCP_BOOTREQUEST            1
+#define       DHCP_BOOTREPLY              2
+#define       DHCP_HEADER_SIZE            236
+
+#define       DHCP_REQUEST                3
+#define       DHCP_ACK                    5
+#define       DHCP_NAK                    6
+
+#define       DHCP_OPTION_PAD             0
+#define       DHCP_OPTION_SUBNET          1
+#define       DHCP_OPTION_ROUTER          3
+#define       DHCP_OPTION_DNS             6
+#define       DHCP_OPTION_REQUESTED_IP    50
+#define       DHCP_OPTION_LEASE_TIME      51
+#define       DHCP_OPTION_MESSAGE_TYPE    53
+#define       DHCP_OPTION_SERVER_ID       54
+#define       DHCP_OPTION_PARAMETERS      55
+#define       DHCP_OPTION_RENEW_TIME      58
+#define       DHCP_OPTION_REBIND_TIME     59
+#define       DHCP_OPTION_CLIENT_ID       61
+#define       DHCP_OPTION_END             255
+
+static const uint8_t DHCP_MAGIC_COOKIE[] = { 99, 130, 83, 99 };
+
+// Lease cached across restarts, the hash tells a cached lease apart from
+// whatever is in RTC memory after a power cycle
+struct _cachedLease
+{
+  uint8_t mac[6];
+  uint8_t ip[4];
+  uint8_t subnet[4];
+  uint8_t gateway[4];
+  uint8_t dns[4];
+  uint32_t hash;
+};
+
+static RTC_NOINIT_ATTR _cachedLease _cache;
+
+static uint32_t _hashLease(void)
+{
+  OXRS_HashPrint hash;
+  hash.write((const uint8_t *)&_cache, offsetof(_cachedLease, hash));
+  return hash.hash;
+}
+
+static void _copyAddress(uint8_t * dst, IPAddress ip)
+{
+  for (uint8_t i = 0; i < 4; i++) { dst[i] = ip[i]; }
+}
+
+static uint32_t _readUint32(const uint8_t * value)
+{
+  return ((uint32_t)value[0] << 24) | ((uint32_t)value[1] << 16) | ((uint32_t)value[2] << 8) | value[3];
+}
+
+OXRS_DhcpLease::OXRS_DhcpLease()
+{
+  _xid = 0;
+  _active = false;
+  _waiting = false;
+  _leaseStartMs = 0;
+  _leaseMs = 0;
+  _renewMs = 0;
+  _rebindMs = 0;
+  _requestMs = 0;
+}
+
+bool OXRS_DhcpLease::reboot(byte * mac)
+{
+  memcpy(_mac, mac, 6);
+
+  if (_cache.hash != _hashLease() || memcmp(_cache.mac, mac, 6) != 0) { return false; }
+
+  // Bring up the W5500 without an address (as Ethernet.begin() does for DHCP)
+  Ethernet.begin(mac, IPAddress(0, 0, 0, 0), IPAddress(_cache.dns), IPAddress(_cache.gateway), IPAddress(_cache.subnet));
+  if (Ethernet.hardwareStatus() == EthernetNoHardware) { return false; }
+
+  // INIT-REBOOT, i.e. broadcast a request for our old address
+  _xid = esp_random();
+  _udp.begin(DHCP_CLIENT_PORT);
+  _sendRequest(IPAddress(255, 255, 255, 255), IPAddress(0, 0, 0, 0), IPAddress(_cache.ip));
+
+  _reply reply;
+  uint8_t type = 0;
+  uint32_t startMs = millis();
+  while (type != DHCP_ACK && type != DHCP_NAK && (millis() - startMs) < DHCP_REBOOT_TIMEOUT_MS)
+  {
+    type = _receive(reply);
+    if (type == 0) { delay(1); }
+  }
+
+  _udp.stop();
+
+  if (type == DHCP_ACK)
+  {
+    _apply(reply);
+    return true;
+  }
+
+  // Our old address is no longer ours
+  if (type == DHCP_NAK) { clear(); }
+  return false;
+}
+
+void OXRS_DhcpLease::save(void)
+{
+  Ethernet.MACAddress(_cache.mac);
+  _copyAddress(_cache.ip, Ethernet.localIP());
+  _copyAddress(_cache.subnet, Ethernet.subnetMask());
+  _copyAddress(_cache.gateway, Ethernet.gatewayIP());
+  _copyAddress(_cache.dns, Ethernet.dnsServerIP());
+  _cache.hash = _hashLease();
+}
+
+void OXRS_DhcpLease::clear(void)
+{
+  memset(&_cache, 0, sizeof(_cache));
+}
+
+bool OXRS_DhcpLease::loop(void)
+{
+  if (!_active) { return true; }
+
+  uint32_t elapsedMs = millis() - _leaseStartMs;
+  if (elapsedMs >= _leaseMs)
+  {
+    _udp.stop();
+    _active = false;
+    return false;
+  }
+
+  if (elapsedMs < _renewMs) { return true; }
+
+  if (_waiting)
+  {
+    _reply reply;
+    uint8_t type = _receive(reply);
+
+    if (type == DHCP_ACK)
+    {
+      _udp.stop();
+      _apply(reply);
+      return true;
+    }
+
+    if (type == DHCP_NAK)
+    {
+      _udp.stop();
+      _active = false;
+      clear();
+      return false;
+    }
+
+    if ((millis() - _requestMs) < DHCP_RENEW_RETRY_MS) { return true; }
+
+    // No reply, so try again
+    _udp.stop();
+    _waiting = false;
+  }
+
+  // Renew with the server which gave us the lease, or any server after T2
+  IPAddress destination = elapsedMs < _rebindMs ? _server : IPAddress(255, 255, 255, 255);
+
+  _xid = esp_random();
+  _udp.begin(DHCP_CLIENT_PORT);
+  _sendRequest(destination, Ethernet.localIP(), IPAddress(0, 0, 0, 0));
+
+  _requestMs = millis();
+  _waiting = true;
+  return true;
+}
+
+void OXRS_DhcpLease::_sendRequest(IPAddress destination, IPAddress clientIp, IPAddress requestedIp)
+{
+  // op, htype, hlen, hops, xid, secs, flags, ciaddr, yiaddr, siaddr, giaddr, chaddr
+  uint8_t header[44];
+  memset(header, 0, sizeof(header));
+
+  header[0] = DHCP_BOOTREQUEST;
+  header[1] = 1;
+  header[2] = 6;
+  memcpy(&header[4], &_xid, 4);
+
+  // Ask for a broadcast reply until we have an address to receive it on
+  if ((uint32_t)clientIp == 0) { header[10] = 0x80; }
+
+  _copyAddress(&header[12], clientIp);
+  memcpy(&header[28], _mac, 6);
+
+  uint8_t options[32];
+  uint8_t length = 0;
+
+  memcpy(options, DHCP_MAGIC_COOKIE, 4);
+  length += 4;
+
+  options[length++] = DHCP_OPTION_MESSAGE_TYPE;
+  options[length++] = 1;
+  options[length++] = DHCP_REQUEST;
+
+  options[length++] = DHCP_OPTION_CLIENT_ID;
+  options[length++] = 7;
+  options[length++] = 1;
+  memcpy(&options[length], _mac, 6);
+  length += 6;
+
+  if ((uint32_t)requestedIp != 0)
+  {
+    options[length++] = DHCP_OPTION_REQUESTED_IP;
+    options[length++] = 4;
+    _copyAddress(&options[length], requestedIp);
+    length += 4;
+  }
+
+  options[length++] = DHCP_OPTION_PARAMETERS;
+  options[length++] = 3;
+  options[length++] = DHCP_OPTION_SUBNET;
+  options[length++] = DHCP_OPTION_ROUTER;
+  options[length++] = DHCP_OPTION_DNS;
+
+  options[length++] = DHCP_OPTION_END;
+
+  // Header, then empty sname and file fields, then options
+  uint8_t zeros[32];
+  memset(zeros, 0, sizeof(zeros));
+
+  _udp.beginPacket(destination, DHCP_SERVER_PORT);
+  _udp.write(header, sizeof(header));
+  for (uint16_t i = sizeof(header); i < DHCP_HEADER_SIZE; i += sizeof(zeros))
+  {
+    _udp.write(zeros, sizeof(zeros));
+  }
+  _udp.write(options, length);
+  _udp.endPacket();
+}
+
+uint8_t OXRS_DhcpLease::_receive(_reply & reply)
+{
+  if (_udp.parsePacket() <= 0) { return 0; }
+
+  uint8_t message[DHCP_MESSAGE_SIZE];
+  int length = _udp.read(message, sizeof(message));
+  _udp.flush();
+
+  // Only interested in replies to our last request
+  if (length < DHCP_HEADER_SIZE + 4) { return 0; }
+  if (message[0] != DHCP_BOOTREPLY) { return 0; }
+  if (memcmp(&message[4], &_xid, 4) != 0) { return 0; }
+  if (memcmp(&message[28], _mac, 6) != 0) { return 0; }
+  if (memcmp(&message[DHCP_HEADER_SIZE], DHCP_MAGIC_COOKIE, 4) != 0) { return 0; }
+
+  reply = _reply();
+  reply.ip = IPAddress(&message[16]);
+
+  uint8_t type = 0;
+  int i = DHCP_HEADER_SIZE + 4;
+  while (i < length && message[i] != DHCP_OPTION_END)
+  {
+    uint8_t option = message[i++];
+    if (option == DHCP_OPTION_PAD) { continue; }
+    if (i >= length) { break; }
+
+    uint8_t optionLength = message[i++];
+    if (i + optionLength > length) { break; }
+
+    const uint8_t * value = &message[i];
+    i += optionLength;
+
+    // Ignore anything too short to hold the values we want
+    if (optionLength < (option == DHCP_OPTION_MESSAGE_TYPE ? 1 : 4)) { continue; }
+
+    switch (option)
+    {
+      case DHCP_OPTION_MESSAGE_TYPE:
+        type = value[0];
+        break;
+      case DHCP_OPTION_SUBNET:
+        reply.subnet = IPAddress(value);
+        break;
+      case DHCP_OPTION_ROUTER:
+        reply.gateway = IPAddress(value);
+        break;
+      case DHCP_OPTION_DNS:
+        reply.dns = IPAddress(value);
+        break;
+      case DHCP_OPTION_SERVER_ID:
+        reply.server = IPAddress(value);
+        break;
+      case DHCP_OPTION_LEASE_TIME:
+        reply.leaseSeconds = _readUint32(value);
+        break;
+      case DHCP_OPTION_RENEW_TIME:
+        reply.renewSeconds = _readUint32(value);
+        break;
+      case DHCP_OPTION_REBIND_TIME:
+        reply.rebindSeconds = _readUint32(value);
+        break;
+    }
+  }
+
+  if (type == DHCP_ACK && (uint32_t)reply.server == 0) { reply.server = _udp.remoteIP(); }
+  return type;
+}
+
+void OXRS_DhcpLease::_apply(const _reply & reply)
+{
+  Ethernet.setLocalIP(reply.ip);
+  if ((uint32_t)reply.subnet != 0) { Ethernet.setSubnetMask(reply.subnet); }
+  if ((uint32_t)reply.gateway != 0) { Ethernet.setGatewayIP(reply.gateway); }
+  if ((uint32_t)reply.dns != 0) { Ethernet.setDnsServerIP(reply.dns); }
+
+  // Renew at T1 and rebind at T2, defaulting to 1/2 and 7/8 of the lease
+  uint32_t leaseSeconds = reply.leaseSeconds;
+  if (leaseSeconds == 0 || leaseSeconds > DHCP_MAX_LEASE_SECONDS) { leaseSeconds = DHCP_MAX_LEASE_SECONDS; }
+
+  _leaseMs = leaseSeconds * 1000;
+  _renewMs = reply.renewSeconds > 0 && reply.renewSeconds < leaseSeconds ? reply.renewSeconds * 1000 : _leaseMs / 2;
+  _rebindMs = reply.rebindSeconds > 0 && reply.rebindSeconds < leaseSeconds ? reply.rebindSeconds * 1000 : _leaseMs / 8 * 7;
+
+  _server = reply.server;
+  _leaseStartMs = millis();
+  _active = true;
+  _waiting = false;
+
+  save();
+}
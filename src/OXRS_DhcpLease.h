@@ -0,0 +1,84 @@
+/*
+ * OXRS_DhcpLease.h
+ */
+
+#ifndef OXRS_DhcpLease_H
+#define OXRS_DhcpLease_H
+
+#include <Arduino.h>
+#include <Ethernet.h>
+
+// How long to wait at boot for the server to confirm a cached lease,
+// before falling back to full discovery
+#define       DHCP_REBOOT_TIMEOUT_MS      1000
+
+// Renewal requests are retried this often until the lease is renewed
+// or expires (when full discovery is needed)
+#define       DHCP_RENEW_RETRY_MS         10000
+
+// Longest lease we honour, so lease times fit in a millis() interval
+#define       DHCP_MAX_LEASE_SECONDS      604800
+
+// Longest DHCP message we read
+#define       DHCP_MESSAGE_SIZE           548
+
+// Caches our DHCP lease across restarts (in RTC memory, so survives a
+// restart or OTA update but not a power cycle) and reacquires it with a
+// single INIT-REBOOT request, rather than a full DISCOVER/OFFER/REQUEST/ACK
+class OXRS_DhcpLease
+{
+  public:
+    OXRS_DhcpLease();
+
+    // Reacquire the lease cached before the last restart, bringing up the
+    // W5500 as it does - returns false if nothing is cached for this MAC,
+    // or the server refused it (NAK) or didn't reply in time
+    bool reboot(byte * mac);
+
+    // Cache the current address (e.g. after full discovery by
+    // Ethernet.begin()) so it can be reacquired after the next restart
+    void save(void);
+
+    // Forget the cached lease
+    void clear(void);
+
+    // True if we are maintaining a lease we reacquired ourselves, since
+    // Ethernet.maintain() only knows about leases from Ethernet.begin()
+    bool active(void) { return _active; }
+
+    // Renew at T1 (with our server) and rebind at T2 (with any server) -
+    // returns false once the lease has expired, when full discovery is needed
+    bool loop(void);
+
+  private:
+    struct _reply
+    {
+      IPAddress ip;
+      IPAddress subnet;
+      IPAddress gateway;
+      IPAddress dns;
+      IPAddress server;
+      uint32_t leaseSeconds;
+      uint32_t renewSeconds;
+      uint32_t rebindSeconds;
+    };
+
+    EthernetUDP _udp;
+    byte _mac[6];
+    uint32_t _xid;
+
+    bool _active;
+    bool _waiting;
+    IPAddress _server;
+    uint32_t _leaseStartMs;
+    uint32_t _leaseMs;
+    uint32_t _renewMs;
+    uint32_t _rebindMs;
+    uint32_t _requestMs;
+
+    void _sendRequest(IPAddress destination, IPAddress clientIp, IPAddress requestedIp);
+    uint8_t _receive(_reply & reply);
+    void _apply(const _reply & reply);
+};
+
+#endif
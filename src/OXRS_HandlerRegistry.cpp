@@ -0,0 +1,94 @@
+/*
+ * OXRS_HandlerRegistry.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_HandlerRegistry.h"
+#include "OXRS_Hash.h"
+
+OXRS_HandlerRegistry::OXRS_HandlerRegistry() : _handlers(HANDLER_REGISTRY_SIZE)
+{
+}
+
+OXRS_HandlerRegistry::~OXRS_HandlerRegistry()
+{
+  _handlers.each([](_handler & slot) { free(slot.key); });
+}
+
+bool OXRS_HandlerRegistry::add(const char * key, jsonCallback handler)
+{
+  _handler * slot = _insert(key);
+  if (!slot) { return false; }
+
+  slot->handler = handler;
+  slot->indexedHandler = NULL;
+  return true;
+}
+
+bool OXRS_HandlerRegistry::add(const char * key, indexedJsonCallback handler)
+{
+  _handler * slot = _insert(key);
+  if (!slot) { return false; }
+
+  slot->handler = NULL;
+  slot->indexedHandler = handler;
+  return true;
+}
+
+uint8_t OXRS_HandlerRegistry::dispatch(JsonVariant json)
+{
+  if (_handlers.count() == 0 || !json.is<JsonObject>()) { return 0; }
+
+  uint8_t handled = 0;
+  for (JsonPair kvp : json.as<JsonObject>())
+  {
+    _handler * slot = _find(kvp.key().c_str());
+    if (!slot) { continue; }
+
+    if (slot->handler)
+    {
+      slot->handler(kvp.value());
+    }
+    else if (slot->indexedHandler)
+    {
+      // Only array elements with an index are passed on
+      for (JsonVariant item : kvp.value().as<JsonArray>())
+      {
+        if (item["index"].is<uint8_t>())
+        {
+          slot->indexedHandler(item["index"].as<uint8_t>(), item);
+        }
+      }
+    }
+
+    handled++;
+  }
+
+  return handled;
+}
+
+OXRS_HandlerRegistry::_handler * OXRS_HandlerRegistry::_find(const char * key)
+{
+  // Hashes can collide, so confirm the key itself
+  return _handlers.find(_table::slotHash(oxrsHash(key)), [key](const _handler & slot) { return strcmp(slot.key, key) == 0; });
+}
+
+OXRS_HandlerRegistry::_handler * OXRS_HandlerRegistry::_insert(const char * key)
+{
+  _handler * slot = _find(key);
+  if (slot) { return slot; }
+
+  // Keep our own copy of the key, it may not outlive the registration
+  char * copy = strdup(key);
+  if (!copy) { return NULL; }
+
+  slot = _handlers.insert(_table::slotHash(oxrsHash(key)));
+  if (!slot)
+  {
+    free(copy);
+    return NULL;
+  }
+
+  slot->key = copy;
+  return slot;
+}
@@ -0,0 +1,47 @@
+/*
+ * OXRS_HandlerRegistry.h
+ */
+
+#ifndef OXRS_HandlerRegistry_H
+#define OXRS_HandlerRegistry_H
+
+#include <OXRS_MQTT.h>                // For jsonCallback
+#include "OXRS_HashTable.h"
+
+// Initial table size (must be a power of 2), grows as handlers are added
+#define       HANDLER_REGISTRY_SIZE       16
+
+// Handler for an array of indexed objects, called once per array element
+typedef void (*indexedJsonCallback)(uint8_t index, JsonVariant json);
+
+class OXRS_HandlerRegistry
+{
+  public:
+    OXRS_HandlerRegistry();
+    ~OXRS_HandlerRegistry();
+
+    // Register a handler for a top-level key (replaces any existing handler)
+    bool add(const char * key, jsonCallback handler);
+    bool add(const char * key, indexedJsonCallback handler);
+
+    // Call the handlers for every registered key in a single pass over
+    // the payload - returns the number of keys handled
+    uint8_t dispatch(JsonVariant json);
+
+  private:
+    struct _handler
+    {
+      uint32_t hash;
+      char * key;
+      jsonCallback handler;
+      indexedJsonCallback indexedHandler;
+    };
+
+    typedef OXRS_HashTable<_handler> _table;
+    _table _handlers;
+
+    _handler * _find(const char * key);
+    _handler * _insert(const char * key);
+};
+
+#endif
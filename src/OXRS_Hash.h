@@ -0,0 +1,42 @@
+/*
+ * OXRS_Hash.h
+ */
+
+#ifndef OXRS_Hash_H
+#define OXRS_Hash_H
+
+#include <Arduino.h>
+
+// 32-bit FNV-1a, used to key the compiled lookup tables
+#define       OXRS_HASH_SEED              2166136261UL
+#define       OXRS_HASH_PRIME             16777619UL
+
+inline uint32_t oxrsHash(const char * str, uint32_t hash = OXRS_HASH_SEED)
+{
+  while (*str)
+  {
+    hash ^= (uint8_t)*str++;
+    hash *= OXRS_HASH_PRIME;
+  }
+  return hash;
+}
+
+// Print sink that hashes whatever is written to it, so we can hash
+// json values with serializeJson() without allocating a buffer
+class OXRS_HashPrint : public Print
+{
+  public:
+    OXRS_HashPrint(uint32_t seed = OXRS_HASH_SEED) : hash(seed) {}
+
+    virtual size_t write(uint8_t character)
+    {
+      hash ^= character;
+      hash *= OXRS_HASH_PRIME;
+      return 1;
+    }
+    using Print::write;
+
+    uint32_t hash;
+};
+
+#endif
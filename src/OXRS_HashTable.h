@@ -0,0 +1,111 @@
+/*
+ * OXRS_HashTable.h
+ */
+
+#ifndef OXRS_HashTable_H
+#define OXRS_HashTable_H
+
+#include <Arduino.h>
+
+// Hash 0 marks an empty slot
+#define       HASH_TABLE_EMPTY_SLOT       0
+
+// Open-addressed (linear probing) table of Entry structs, shared by the
+// compiled lookup tables. Entry must have a uint32_t hash member, hashes
+// only pick the slot so callers confirm the key with match() on a hit.
+template <class Entry>
+class OXRS_HashTable
+{
+  public:
+    // Initial size must be a power of 2, the table doubles as it fills
+    OXRS_HashTable(uint16_t initialSize) : _entries(NULL), _size(0), _count(0), _initialSize(initialSize) {}
+    ~OXRS_HashTable() { free(_entries); }
+
+    // Never returns the empty slot marker, so any key hash can be stored
+    static uint32_t slotHash(uint32_t hash) { return hash == HASH_TABLE_EMPTY_SLOT ? 1 : hash; }
+
+    // The entry with this hash for which match(entry) is true, or NULL
+    template <class Match>
+    Entry * find(uint32_t hash, Match match)
+    {
+      if (_count == 0) { return NULL; }
+
+      // The table is never allowed to fill, so there is always an empty slot
+      uint16_t mask = _size - 1;
+      for (uint16_t i = hash & mask; _entries[i].hash != HASH_TABLE_EMPTY_SLOT; i = (i + 1) & mask)
+      {
+        if (_entries[i].hash == hash && match(_entries[i])) { return &_entries[i]; }
+      }
+
+      return NULL;
+    }
+
+    // Claim a new (zeroed) entry for this hash, call only once find() has
+    // missed - returns NULL if the table couldn't grow
+    Entry * insert(uint32_t hash)
+    {
+      // Keep the load factor under 3/4 so probe chains stay short
+      if ((_count + 1) * 4 > _size * 3 && !_grow()) { return NULL; }
+
+      uint16_t mask = _size - 1;
+      uint16_t i = hash & mask;
+      while (_entries[i].hash != HASH_TABLE_EMPTY_SLOT) { i = (i + 1) & mask; }
+
+      _entries[i].hash = hash;
+      _count++;
+      return &_entries[i];
+    }
+
+    // Call visit(entry) for every entry, e.g. to free anything they own
+    template <class Visit>
+    void each(Visit visit)
+    {
+      for (uint16_t i = 0; i < _size; i++)
+      {
+        if (_entries[i].hash != HASH_TABLE_EMPTY_SLOT) { visit(_entries[i]); }
+      }
+    }
+
+    // Empty the table (free anything the entries own with each() first)
+    void clear(void)
+    {
+      free(_entries);
+      _entries = NULL;
+      _size = 0;
+      _count = 0;
+    }
+
+    uint16_t count(void) { return _count; }
+
+  private:
+    Entry * _entries;
+    uint16_t _size;
+    uint16_t _count;
+    uint16_t _initialSize;
+
+    bool _grow(void)
+    {
+      uint16_t size = _size ? _size * 2 : _initialSize;
+
+      Entry * entries = (Entry *)calloc(size, sizeof(Entry));
+      if (!entries) { return false; }
+
+      // Rehash any existing entries into the new table
+      uint16_t mask = size - 1;
+      for (uint16_t j = 0; j < _size; j++)
+      {
+        if (_entries[j].hash == HASH_TABLE_EMPTY_SLOT) { continue; }
+
+        uint16_t i = _entries[j].hash & mask;
+        while (entries[i].hash != HASH_TABLE_EMPTY_SLOT) { i = (i + 1) & mask; }
+        entries[i] = _entries[j];
+      }
+
+      free(_entries);
+      _entries = entries;
+      _size = size;
+      return true;
+    }
+};
+
+#endif
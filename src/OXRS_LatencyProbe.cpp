@@ -0,0 +1,138 @@
+/*
+ * OXRS_LatencyProbe.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_LatencyProbe.h"
+
+const uint32_t OXRS_LatencyProbe::BUCKETS_MS[LATENCY_PROBE_BUCKETS] = { 1, 2, 5, 10, 25, 50, 100, 250 };
+
+OXRS_LatencyProbe::OXRS_LatencyProbe(OXRS_Outbound & outbound, PubSubClient & client)
+{
+  _outbound = &outbound;
+  _client = &client;
+  _topic[0] = 0;
+  _subscribed = false;
+
+  _intervalMs = 0;
+  _lastProbeMs = 0;
+  _sequence = 0;
+  _pending = false;
+  _timed = false;
+
+  _sampleCount = 0;
+  _sampleNext = 0;
+
+  memset(buckets, 0, sizeof(buckets));
+  sumUs = 0;
+  count = 0;
+  lost = 0;
+}
+
+void OXRS_LatencyProbe::setInterval(uint32_t intervalMs)
+{
+  _intervalMs = intervalMs;
+}
+
+void OXRS_LatencyProbe::begin(const char * topic)
+{
+  strncpy(_topic, topic, sizeof(_topic) - 1);
+  _topic[sizeof(_topic) - 1] = 0;
+
+  // Subscriptions don't survive a reconnect
+  _subscribed = false;
+  _pending = false;
+}
+
+bool OXRS_LatencyProbe::receive(const char * topic, const uint8_t * payload, unsigned int length)
+{
+  if (!_topic[0] || strcmp(topic, _topic) != 0) { return false; }
+
+  uint32_t now = micros();
+
+  // The broker echoes our payload verbatim, so no need for a json parser
+  char buffer[48];
+  if (length >= sizeof(buffer)) { return true; }
+  memcpy(buffer, payload, length);
+  buffer[length] = 0;
+
+  unsigned long sequence, sentUs;
+  if (sscanf(buffer, "{\"probe\":%lu,\"sentUs\":%lu}", &sequence, &sentUs) != 2) { return true; }
+
+  // Ignore anything but the probe we are waiting for
+  if (!_pending || sequence != _sequence) { return true; }
+  _pending = false;
+
+  // Held back by the rate limit, so this measured our queue not the broker
+  if (!_timed) { return true; }
+
+  _record(now - sentUs);
+  return true;
+}
+
+void OXRS_LatencyProbe::loop(void)
+{
+  if (_intervalMs == 0 || !_topic[0] || !_client->connected()) { return; }
+
+  if (!_subscribed)
+  {
+    _subscribed = _client->subscribe(_topic);
+    if (!_subscribed) { return; }
+  }
+
+  if (_sequence > 0 && (millis() - _lastProbeMs) < _intervalMs) { return; }
+  _lastProbeMs = millis();
+
+  // Previous probe never came back
+  if (_pending) { lost++; }
+
+  // Publish now if nothing is queued ahead of it and the rate limit allows,
+  // otherwise it waits its turn like any other telemetry (and its echo
+  // isn't timed, since that would measure our queue not the broker)
+  char payload[48];
+  sprintf_P(payload, PSTR("{\"probe\":%lu,\"sentUs\":%lu}"), (unsigned long)++_sequence, (unsigned long)micros());
+
+  _timed = _outbound->publishNow(OUTBOUND_TELEMETRY, _topic, (const uint8_t *)payload, strlen(payload));
+  _pending = true;
+}
+
+void OXRS_LatencyProbe::getJson(JsonVariant json)
+{
+  JsonObject rtt = json["mqttRtt"].to<JsonObject>();
+
+  rtt["samples"] = _sampleCount;
+  rtt["lost"] = lost;
+  if (_sampleCount == 0) { return; }
+
+  // Small enough to just sort a copy
+  uint32_t sorted[LATENCY_PROBE_SAMPLES];
+  memcpy(sorted, _samples, _sampleCount * sizeof(uint32_t));
+  for (uint8_t i = 1; i < _sampleCount; i++)
+  {
+    uint32_t sample = sorted[i];
+    uint8_t j = i;
+    while (j > 0 && sorted[j - 1] > sample)
+    {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = sample;
+  }
+
+  rtt["p50Ms"] = sorted[(_sampleCount - 1) * 50 / 100] / 1000.0;
+  rtt["p99Ms"] = sorted[(_sampleCount - 1) * 99 / 100] / 1000.0;
+}
+
+void OXRS_LatencyProbe::_record(uint32_t rttUs)
+{
+  _samples[_sampleNext] = rttUs;
+  _sampleNext = (_sampleNext + 1) % LATENCY_PROBE_SAMPLES;
+  if (_sampleCount < LATENCY_PROBE_SAMPLES) { _sampleCount++; }
+
+  uint8_t bucket = 0;
+  while (bucket < LATENCY_PROBE_BUCKETS && rttUs > BUCKETS_MS[bucket] * 1000) { bucket++; }
+
+  buckets[bucket]++;
+  sumUs += rttUs;
+  count++;
+}
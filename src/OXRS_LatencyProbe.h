@@ -0,0 +1,69 @@
+/*
+ * OXRS_LatencyProbe.h
+ */
+
+#ifndef OXRS_LatencyProbe_H
+#define OXRS_LatencyProbe_H
+
+#include <ArduinoJson.h>
+#include <PubSubClient.h>
+#include "OXRS_Outbound.h"
+
+// Round-trip times kept for the rolling percentiles
+#define       LATENCY_PROBE_SAMPLES       64
+
+// Cumulative RTT histogram buckets (upper bounds in milliseconds)
+#define       LATENCY_PROBE_BUCKETS       8
+
+// Periodically publishes a timestamped message to a device-private topic
+// we are subscribed to, and measures how long the broker takes to echo it.
+// Probes go out through the outbound scheduler on the telemetry class, as
+// {"probe": <sequence>, "sentUs": <micros>} on <telemetry topic>/probe.
+class OXRS_LatencyProbe
+{
+  public:
+    OXRS_LatencyProbe(OXRS_Outbound & outbound, PubSubClient & client);
+
+    // How often to probe (0 disables)
+    void setInterval(uint32_t intervalMs);
+
+    // Set the probe topic, called each time we (re)connect
+    void begin(const char * topic);
+
+    // Returns true if this was one of our probes (so needs no more handling)
+    bool receive(const char * topic, const uint8_t * payload, unsigned int length);
+
+    // Send a probe when due
+    void loop(void);
+
+    // p50/p99 RTT over the last LATENCY_PROBE_SAMPLES probes
+    void getJson(JsonVariant json);
+
+    // Histogram for /metrics
+    static const uint32_t BUCKETS_MS[LATENCY_PROBE_BUCKETS];
+    uint32_t buckets[LATENCY_PROBE_BUCKETS + 1];
+    uint64_t sumUs;
+    uint32_t count;
+    uint32_t lost;
+
+  private:
+    OXRS_Outbound * _outbound;
+    PubSubClient * _client;
+
+    char _topic[64];
+    bool _subscribed;
+
+    uint32_t _intervalMs;
+    uint32_t _lastProbeMs;
+    uint32_t _sequence;
+    bool _pending;
+    bool _timed;
+
+    uint32_t _samples[LATENCY_PROBE_SAMPLES];
+    uint8_t _sampleCount;
+    uint8_t _sampleNext;
+
+    void _record(uint32_t rttUs);
+};
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * OXRS_LcdScheduler.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_LcdScheduler.h"
+
+OXRS_LcdScheduler::OXRS_LcdScheduler()
+{
+  framesDrawn = 0;
+  eventsDropped = 0;
+
+  _frameMs = 0;
+  portMUX_INITIALIZE(&_lock);
+  _event[0] = 0;
+  _rxLed = false;
+  _txLed = false;
+
+  setFrameRate(LCD_FRAME_RATE);
+}
+
+void OXRS_LcdScheduler::setFrameRate(uint8_t framesPerSecond)
+{
+  _frameIntervalMs = framesPerSecond > 0 ? 1000 / framesPerSecond : 0;
+}
+
+void OXRS_LcdScheduler::showEvent(const char * event)
+{
+  portENTER_CRITICAL(&_lock);
+  if (_event[0]) { eventsDropped++; }
+
+  strncpy(_event, event, LCD_EVENT_SIZE - 1);
+  _event[LCD_EVENT_SIZE - 1] = 0;
+  portEXIT_CRITICAL(&_lock);
+}
+
+void OXRS_LcdScheduler::getJson(JsonVariant json)
+{
+  JsonObject lcd = json["lcd"].to<JsonObject>();
+
+  lcd["framesDrawn"] = framesDrawn;
+  lcd["eventsDropped"] = eventsDropped;
+}
@@ -0,0 +1,78 @@
+/*
+ * OXRS_LcdScheduler.h
+ */
+
+#ifndef OXRS_LcdScheduler_H
+#define OXRS_LcdScheduler_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Default maximum LCD redraws per second
+#define       LCD_FRAME_RATE              10
+
+// Longest event text shown on the LCD
+#define       LCD_EVENT_SIZE              32
+
+// Coalesces LCD updates so bursts of events and MQTT traffic redraw the
+// screen at most once per frame, always showing the latest event. Updates
+// can be queued from one task and rendered from another.
+class OXRS_LcdScheduler
+{
+  public:
+    OXRS_LcdScheduler();
+
+    // Maximum redraws per second (0 redraws on every render() call)
+    void setFrameRate(uint8_t framesPerSecond);
+
+    // Queue an update for the next frame (an event still pending when a
+    // newer one arrives is dropped)
+    void showEvent(const char * event);
+    void triggerMqttRxLed(void) { _rxLed = true; }
+    void triggerMqttTxLed(void) { _txLed = true; }
+
+    // Draw only the regions (event line, rx/tx LEDs) updated since the
+    // last frame, if a frame is due - returns true if anything was drawn.
+    // A Lock is held while each region is drawn (e.g. to share the bus).
+    template <class Lock, class Screen>
+    bool render(Screen & screen)
+    {
+      if (!_event[0] && !_rxLed && !_txLed) { return false; }
+      if ((millis() - _frameMs) < _frameIntervalMs) { return false; }
+
+      // Take the dirty regions, so updates can keep arriving while we draw
+      char event[LCD_EVENT_SIZE];
+      portENTER_CRITICAL(&_lock);
+      strcpy(event, _event);
+      _event[0] = 0;
+      bool rxLed = _rxLed;
+      bool txLed = _txLed;
+      _rxLed = _txLed = false;
+      portEXIT_CRITICAL(&_lock);
+
+      if (event[0]) { Lock lock; screen.showEvent(event); }
+      if (rxLed) { Lock lock; screen.triggerMqttRxLed(); }
+      if (txLed) { Lock lock; screen.triggerMqttTxLed(); }
+
+      _frameMs = millis();
+      framesDrawn++;
+      return true;
+    }
+
+    // Frames drawn vs events dropped
+    void getJson(JsonVariant json);
+
+    uint32_t framesDrawn;
+    uint32_t eventsDropped;
+
+  private:
+    uint16_t _frameIntervalMs;
+    uint32_t _frameMs;
+
+    portMUX_TYPE _lock;
+    char _event[LCD_EVENT_SIZE];
+    volatile bool _rxLed;
+    volatile bool _txLed;
+};
+
+#endif
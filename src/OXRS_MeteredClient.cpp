@@ -0,0 +1,210 @@
+/*
+ * OXRS_MeteredClient.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_MeteredClient.h"
+
+OXRS_MeteredClient::OXRS_MeteredClient(Client * client)
+{
+  _client = client;
+  bytesIn = 0;
+  bytesOut = 0;
+  sends = 0;
+  receives = 0;
+  sendFailures = 0;
+
+  _buffer = NULL;
+  _bufferSize = 0;
+  _buffered = 0;
+
+  _readBuffer = NULL;
+  _readBufferSize = 0;
+  _readStart = 0;
+  _readEnd = 0;
+}
+
+void OXRS_MeteredClient::setClient(Client * client)
+{
+  push();
+  _readStart = _readEnd = 0;
+  _client = client;
+}
+
+void OXRS_MeteredClient::setBufferSize(size_t size)
+{
+  push();
+
+  free(_buffer);
+  _buffer = size > 0 ? (uint8_t *)malloc(size) : NULL;
+  _bufferSize = _buffer ? size : 0;
+}
+
+void OXRS_MeteredClient::setReadBufferSize(size_t size)
+{
+  // Drops anything already read ahead
+  _readStart = _readEnd = 0;
+
+  free(_readBuffer);
+  _readBuffer = size > 0 ? (uint8_t *)malloc(size) : NULL;
+  _readBufferSize = _readBuffer ? size : 0;
+}
+
+bool OXRS_MeteredClient::push(void)
+{
+  if (_buffered == 0) { return true; }
+
+  size_t buffered = _buffered;
+  _buffered = 0;
+  return _send(_buffer, buffered) == buffered;
+}
+
+int OXRS_MeteredClient::connect(IPAddress ip, uint16_t port)
+{
+  // Nothing buffered is meant for a new connection
+  _buffered = 0;
+  _readStart = _readEnd = 0;
+  return _client ? _client->connect(ip, port) : 0;
+}
+
+int OXRS_MeteredClient::connect(const char * host, uint16_t port)
+{
+  _buffered = 0;
+  _readStart = _readEnd = 0;
+  return _client ? _client->connect(host, port) : 0;
+}
+
+size_t OXRS_MeteredClient::write(uint8_t character)
+{
+  return write(&character, 1);
+}
+
+size_t OXRS_MeteredClient::write(const uint8_t * buffer, size_t size)
+{
+  if (!_client) { return 0; }
+
+  // Make room, or write straight through if it would fill the buffer anyway
+  if (_buffered + size > _bufferSize && !push()) { return 0; }
+  if (size >= _bufferSize) { return _send(buffer, size); }
+
+  memcpy(&_buffer[_buffered], buffer, size);
+  _buffered += size;
+  return size;
+}
+
+int OXRS_MeteredClient::available(void)
+{
+  // Anything we are waiting for is likely a reply to what is buffered
+  push();
+  if (!_client) { return 0; }
+
+  // Anything read ahead will do, without another round trip to the client
+  if (_readStart < _readEnd) { return _readEnd - _readStart; }
+  return _client->available();
+}
+
+int OXRS_MeteredClient::read(void)
+{
+  uint8_t character;
+  return read(&character, 1) == 1 ? character : -1;
+}
+
+int OXRS_MeteredClient::read(uint8_t * buffer, size_t size)
+{
+  push();
+  if (!_client) { return -1; }
+
+  size_t copied = 0;
+  while (copied < size)
+  {
+    // Anything too big to be worth reading ahead goes straight into the caller's buffer
+    if (_readStart == _readEnd && (size - copied) >= _readBufferSize)
+    {
+      int bytes = _receive(&buffer[copied], size - copied);
+      if (bytes > 0) { copied += bytes; }
+      break;
+    }
+
+    if (!_readAhead()) { break; }
+
+    size_t bytes = _readEnd - _readStart;
+    if (bytes > (size - copied)) { bytes = size - copied; }
+    memcpy(&buffer[copied], &_readBuffer[_readStart], bytes);
+    _readStart += bytes;
+    copied += bytes;
+  }
+
+  return copied > 0 ? (int)copied : -1;
+}
+
+int OXRS_MeteredClient::peek(void)
+{
+  push();
+  if (!_client) { return -1; }
+
+  if (!_readBuffer) { return _client->peek(); }
+  return _readAhead() ? _readBuffer[_readStart] : -1;
+}
+
+void OXRS_MeteredClient::flush(void)
+{
+  push();
+  if (_client) { _client->flush(); }
+}
+
+void OXRS_MeteredClient::stop(void)
+{
+  push();
+  _readStart = _readEnd = 0;
+  if (_client) { _client->stop(); }
+}
+
+uint8_t OXRS_MeteredClient::connected(void)
+{
+  // Like the W5500 client, we are still connected while there is data to read
+  if (_readStart < _readEnd) { return 1; }
+  return _client ? _client->connected() : 0;
+}
+
+OXRS_MeteredClient::operator bool(void)
+{
+  return _client && (bool)*_client;
+}
+
+size_t OXRS_MeteredClient::_send(const uint8_t * buffer, size_t size)
+{
+  if (!_client) { return 0; }
+
+  size_t written = _client->write(buffer, size);
+  bytesOut += written;
+  sends++;
+  if (written != size) { sendFailures++; }
+  return written;
+}
+
+int OXRS_MeteredClient::_receive(uint8_t * buffer, size_t size)
+{
+  if (!_client) { return -1; }
+
+  int bytes = _client->read(buffer, size);
+  if (bytes > 0)
+  {
+    bytesIn += bytes;
+    receives++;
+  }
+  return bytes;
+}
+
+bool OXRS_MeteredClient::_readAhead(void)
+{
+  if (_readStart < _readEnd) { return true; }
+
+  _readStart = _readEnd = 0;
+  if (!_readBuffer) { return false; }
+
+  int bytes = _receive(_readBuffer, _readBufferSize);
+  if (bytes <= 0) { return false; }
+
+  _readEnd = bytes;
+  return true;
+}
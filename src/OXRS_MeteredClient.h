@@ -0,0 +1,75 @@
+/*
+ * OXRS_MeteredClient.h
+ */
+
+#ifndef OXRS_MeteredClient_H
+#define OXRS_MeteredClient_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+// Client wrapper which counts the bytes passing through it, and can
+// coalesce small writes so they go out in a single send, and read ahead
+// so byte-at-a-time reads are served from a single burst
+class OXRS_MeteredClient : public Client
+{
+  public:
+    OXRS_MeteredClient(Client * client = NULL);
+
+    // Swap the wrapped client (anything buffered is written out first and
+    // anything read ahead is dropped, counters are kept)
+    void setClient(Client * client);
+
+    // Buffer up to this many bytes of writes (0 disables buffering), the
+    // buffer is written out when full, before any read, or on push()
+    void setBufferSize(size_t size);
+
+    // Read ahead up to this many bytes at a time (0 disables read ahead)
+    void setReadBufferSize(size_t size);
+
+    // Write out anything buffered - returns false if it failed
+    bool push(void);
+
+    virtual int connect(IPAddress ip, uint16_t port);
+    virtual int connect(const char * host, uint16_t port);
+    virtual size_t write(uint8_t character);
+    virtual size_t write(const uint8_t * buffer, size_t size);
+    virtual int available(void);
+    virtual int read(void);
+    virtual int read(uint8_t * buffer, size_t size);
+    virtual int peek(void);
+    virtual void flush(void);
+    virtual void stop(void);
+    virtual uint8_t connected(void);
+    virtual operator bool(void);
+    using Print::write;
+
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+
+    // Writes to/reads from the wrapped client (i.e. W5500 sends/receives)
+    uint32_t sends;
+    uint32_t receives;
+
+    // Sends which didn't write everything (buffered writes are reported as
+    // written, so this is the only record of them failing)
+    uint32_t sendFailures;
+
+  private:
+    Client * _client;
+
+    uint8_t * _buffer;
+    size_t _bufferSize;
+    size_t _buffered;
+
+    uint8_t * _readBuffer;
+    size_t _readBufferSize;
+    size_t _readStart;
+    size_t _readEnd;
+
+    size_t _send(const uint8_t * buffer, size_t size);
+    int _receive(uint8_t * buffer, size_t size);
+    bool _readAhead(void);
+};
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * OXRS_Outbound.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_Outbound.h"
+
+static const char * LANE_NAMES[OUTBOUND_LANES] = { "status", "reply", "telemetry", "log" };
+
+OXRS_Outbound::OXRS_Outbound(PubSubClient & client, uint8_t queueSize)
+{
+  _client = &client;
+  _onSend = NULL;
+  _queueSize = queueSize > 0 ? queueSize : 1;
+  memset(_lanes, 0, sizeof(_lanes));
+
+  for (uint8_t i = 0; i < OUTBOUND_LANES; i++)
+  {
+    _lanes[i].queue = (_message **)calloc(_queueSize, sizeof(_message *));
+  }
+}
+
+bool OXRS_Outbound::enqueue(uint8_t lane, const char * topic, const uint8_t * payload, size_t length, bool retained)
+{
+  _message * message = _allocate(lane, topic, length, retained);
+  if (!message) { return false; }
+
+  memcpy(&message->data[strlen(topic) + 1], payload, length);
+  return true;
+}
+
+bool OXRS_Outbound::enqueue(uint8_t lane, const char * topic, JsonVariantConst json, bool retained)
+{
+  size_t length = measureJson(json);
+
+  _message * message = _allocate(lane, topic, length, retained);
+  if (!message) { return false; }
+
+  // Includes space for the null terminator serializeJson() insists on
+  serializeJson(json, &message->data[strlen(topic) + 1], length + 1);
+  return true;
+}
+
+bool OXRS_Outbound::publishNow(uint8_t lane, const char * topic, const uint8_t * payload, size_t length, bool retained)
+{
+  if (!enqueue(lane, topic, payload, length, retained)) { return false; }
+
+  // Only this message, anything else queued still goes out via loop()
+  if (_lanes[lane].count > 1 || !_client->connected()) { return false; }
+  if (!_canPublish(lane)) { return false; }
+
+  return _publishNext(lane);
+}
+
+void OXRS_Outbound::setRate(uint8_t lane, float rate, uint16_t burst)
+{
+  if (lane >= OUTBOUND_LANES) { return; }
+
+  _lanes[lane].rate = rate;
+  _lanes[lane].burst = burst > 0 ? burst : 1;
+  _lanes[lane].tokens = _lanes[lane].burst;
+  _lanes[lane].refillMs = millis();
+}
+
+void OXRS_Outbound::onSend(outboundSendCallback callback)
+{
+  _onSend = callback;
+}
+
+bool OXRS_Outbound::flush(uint8_t lane)
+{
+  bool success = true;
+
+  for (uint8_t i = 0; i <= lane && i < OUTBOUND_LANES; i++)
+  {
+    while (_lanes[i].count > 0)
+    {
+      if (!_client->connected()) { return false; }
+
+      // Anything over the rate limit is left for loop() to publish
+      if (!_canPublish(i)) { break; }
+      if (!_publishNext(i)) { success = false; }
+    }
+  }
+
+  return success;
+}
+
+uint8_t OXRS_Outbound::loop(uint8_t maxMessages)
+{
+  uint8_t published = 0;
+
+  // Only check the connection (an SPI round trip) if there is work to do,
+  // and before any rate limit tokens are spent on messages we can't send
+  uint8_t queued = 0;
+  for (uint8_t i = 0; i < OUTBOUND_LANES; i++) { queued += _lanes[i].count; }
+  if (queued == 0 || !_client->connected()) { return 0; }
+
+  while (published < maxMessages)
+  {
+    // Always take from the highest priority class with anything queued
+    // (and within its rate limit)
+    uint8_t lane = 0;
+    while (lane < OUTBOUND_LANES && (_lanes[lane].count == 0 || !_canPublish(lane))) { lane++; }
+    if (lane == OUTBOUND_LANES) { break; }
+
+    // Leave the rest queued if the connection has dropped
+    published++;
+    if (!_publishNext(lane)) { break; }
+  }
+
+  return published;
+}
+
+uint8_t OXRS_Outbound::queued(uint8_t lane)
+{
+  return lane < OUTBOUND_LANES ? _lanes[lane].count : 0;
+}
+
+void OXRS_Outbound::getStats(JsonVariant json)
+{
+  for (uint8_t i = 0; i < OUTBOUND_LANES; i++)
+  {
+    JsonObject lane = json[LANE_NAMES[i]].to<JsonObject>();
+
+    lane["queued"] = _lanes[i].count;
+    lane["published"] = _lanes[i].stats.published;
+    lane["deferred"] = _lanes[i].stats.deferred;
+    lane["dropped"] = _lanes[i].stats.dropped;
+    lane["failed"] = _lanes[i].stats.failed;
+    lane["maxLatencyMs"] = _lanes[i].stats.maxLatencyMs;
+    lane["avgLatencyMs"] = _lanes[i].stats.published ? _lanes[i].stats.totalLatencyMs / _lanes[i].stats.published : 0;
+  }
+}
+
+const outboundStats * OXRS_Outbound::getStats(uint8_t lane)
+{
+  return lane < OUTBOUND_LANES ? &_lanes[lane].stats : NULL;
+}
+
+const char * OXRS_Outbound::getLaneName(uint8_t lane)
+{
+  return lane < OUTBOUND_LANES ? LANE_NAMES[lane] : NULL;
+}
+
+OXRS_Outbound::_message * OXRS_Outbound::_allocate(uint8_t lane, const char * topic, size_t length, bool retained)
+{
+  if (lane >= OUTBOUND_LANES || length > UINT16_MAX) { return NULL; }
+
+  size_t topicLength = strlen(topic);
+  _message * message = (_message *)malloc(sizeof(_message) + topicLength + 1 + length + 1);
+  if (!message) { return NULL; }
+
+  message->queuedMs = millis();
+  message->length = length;
+  message->retained = retained;
+  message->deferred = false;
+  memcpy(message->data, topic, topicLength + 1);
+
+  // Make room by dropping the oldest message in this class
+  _lane * queue = &_lanes[lane];
+  if (queue->count == _queueSize)
+  {
+    free(queue->queue[queue->head]);
+    queue->head = (queue->head + 1) % _queueSize;
+    queue->count--;
+    queue->stats.dropped++;
+  }
+
+  queue->queue[(queue->head + queue->count) % _queueSize] = message;
+  queue->count++;
+  return message;
+}
+
+bool OXRS_Outbound::_canPublish(uint8_t lane)
+{
+  _lane * queue = &_lanes[lane];
+  if (queue->rate <= 0) { return true; }
+
+  // Top up the bucket for the time since it was last refilled
+  uint32_t now = millis();
+  queue->tokens += (now - queue->refillMs) * queue->rate / 1000.0f;
+  if (queue->tokens > queue->burst) { queue->tokens = queue->burst; }
+  queue->refillMs = now;
+
+  if (queue->tokens >= 1.0f)
+  {
+    queue->tokens -= 1.0f;
+    return true;
+  }
+
+  // Only count each message once, however long it waits
+  _message * message = queue->queue[queue->head];
+  if (!message->deferred)
+  {
+    message->deferred = true;
+    queue->stats.deferred++;
+  }
+
+  return false;
+}
+
+bool OXRS_Outbound::_publishNext(uint8_t lane)
+{
+  _lane * queue = &_lanes[lane];
+  _message * message = queue->queue[queue->head];
+
+  queue->head = (queue->head + 1) % _queueSize;
+  queue->count--;
+
+  // Stream the payload so it isn't limited by the client buffer size
+  const char * topic = message->data;
+  const uint8_t * payload = (const uint8_t *)&message->data[strlen(topic) + 1];
+
+  bool success = _client->beginPublish(topic, message->length, message->retained) &&
+                 _client->write(payload, message->length) == message->length &&
+                 _client->endPublish() &&
+                 (!_onSend || _onSend());
+
+  if (success)
+  {
+    uint32_t latencyMs = millis() - message->queuedMs;
+    if (latencyMs > queue->stats.maxLatencyMs) { queue->stats.maxLatencyMs = latencyMs; }
+    queue->stats.totalLatencyMs += latencyMs;
+    queue->stats.published++;
+  }
+  else
+  {
+    queue->stats.failed++;
+  }
+
+  free(message);
+  return success;
+}
+
+OXRS_OutboundLogger::OXRS_OutboundLogger(OXRS_Outbound & outbound, PubSubClient & client)
+{
+  _outbound = &outbound;
+  _client = &client;
+  _topic[0] = 0;
+  _length = 0;
+}
+
+void OXRS_OutboundLogger::setTopic(const char * topic)
+{
+  strncpy(_topic, topic, sizeof(_topic) - 1);
+  _topic[sizeof(_topic) - 1] = 0;
+}
+
+size_t OXRS_OutboundLogger::write(uint8_t character)
+{
+  Serial.write(character);
+
+  if (character == '\r') { return 1; }
+
+  // Queue complete lines (or when the buffer is full)
+  if (character != '\n')
+  {
+    _line[_length++] = character;
+    if (_length < sizeof(_line)) { return 1; }
+  }
+
+  // Only queue if the session is up - state() doesn't touch the network
+  // hardware, so logging never contends for a shared bus
+  if (_length > 0 && _topic[0] && _client->state() == MQTT_CONNECTED)
+  {
+    _outbound->enqueue(OUTBOUND_LOG, _topic, (const uint8_t *)_line, _length);
+  }
+
+  _length = 0;
+  return 1;
+}
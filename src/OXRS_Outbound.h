@@ -0,0 +1,136 @@
+/*
+ * OXRS_Outbound.h
+ */
+
+#ifndef OXRS_Outbound_H
+#define OXRS_Outbound_H
+
+#include <ArduinoJson.h>
+#include <PubSubClient.h>
+
+// Outbound traffic classes, in priority order
+#define       OUTBOUND_STATUS             0
+#define       OUTBOUND_REPLY              1
+#define       OUTBOUND_TELEMETRY          2
+#define       OUTBOUND_LOG                3
+#define       OUTBOUND_LANES              4
+
+// Messages queued per class before the oldest are dropped (default)
+#define       OUTBOUND_QUEUE_SIZE         16
+
+// Maximum log line length
+#define       OUTBOUND_LOG_LINE_SIZE      128
+
+// Per-class counters
+struct outboundStats
+{
+  uint32_t published;
+  uint32_t deferred;
+  uint32_t dropped;
+  uint32_t failed;
+  uint32_t maxLatencyMs;
+  uint32_t totalLatencyMs;
+};
+
+// Called after each publish to send anything the client has buffered
+// (e.g. a coalescing socket wrapper) - returns false if the send failed
+typedef bool (*outboundSendCallback)(void);
+
+class OXRS_Outbound
+{
+  public:
+    OXRS_Outbound(PubSubClient & client, uint8_t queueSize = OUTBOUND_QUEUE_SIZE);
+
+    // Queue a message for publishing (if the class queue is full the
+    // oldest message in that queue is dropped)
+    bool enqueue(uint8_t lane, const char * topic, const uint8_t * payload, size_t length, bool retained = false);
+    bool enqueue(uint8_t lane, const char * topic, JsonVariantConst json, bool retained = false);
+
+    // Queue a message and publish it straight away if nothing is queued ahead
+    // of it in its class and the rate limit allows - returns true only if it
+    // was published now (otherwise it is left for loop() like any other)
+    bool publishNow(uint8_t lane, const char * topic, const uint8_t * payload, size_t length, bool retained = false);
+
+    // Shape a class to an average rate (messages/second) with bursts of up to
+    // burst messages - anything over the limit stays queued until the bucket
+    // refills (a rate of 0 disables shaping for that class)
+    void setRate(uint8_t lane, float rate, uint16_t burst);
+
+    // Push each publish out of any buffering below the MQTT client, so a
+    // failed send is reported (and counted) against the message
+    void onSend(outboundSendCallback callback);
+
+    // Publish everything queued in this class and any higher priority
+    // classes, as far as shaping allows - returns false if any publish failed
+    bool flush(uint8_t lane);
+
+    // Publish up to maxMessages queued messages, highest priority first,
+    // so queued status always preempts queued telemetry and logs
+    uint8_t loop(uint8_t maxMessages);
+
+    // Number of messages queued in a class
+    uint8_t queued(uint8_t lane);
+
+    // Published/deferred/dropped/failed counts and queue latency per class
+    void getStats(JsonVariant json);
+    const outboundStats * getStats(uint8_t lane);
+
+    // Name of a class, e.g. "status"
+    static const char * getLaneName(uint8_t lane);
+
+  private:
+    struct _message
+    {
+      uint32_t queuedMs;
+      uint16_t length;
+      bool retained;
+      bool deferred;
+      char data[];                    // topic\0payload
+    };
+
+    struct _lane
+    {
+      _message ** queue;
+      uint8_t head;
+      uint8_t count;
+
+      float rate;
+      float tokens;
+      uint16_t burst;
+      uint32_t refillMs;
+
+      outboundStats stats;
+    };
+
+    PubSubClient * _client;
+    outboundSendCallback _onSend;
+    _lane _lanes[OUTBOUND_LANES];
+    uint8_t _queueSize;
+
+    _message * _allocate(uint8_t lane, const char * topic, size_t length, bool retained);
+    bool _canPublish(uint8_t lane);
+    bool _publishNext(uint8_t lane);
+};
+
+// Print wrapper which logs to serial and queues each line for publishing
+// on the log class, once a topic is set and the client is connected
+class OXRS_OutboundLogger : public Print
+{
+  public:
+    OXRS_OutboundLogger(OXRS_Outbound & outbound, PubSubClient & client);
+
+    void setTopic(const char * topic);
+
+    virtual size_t write(uint8_t character);
+    using Print::write;
+
+  private:
+    OXRS_Outbound * _outbound;
+    PubSubClient * _client;
+
+    char _topic[64];
+    char _line[OUTBOUND_LOG_LINE_SIZE];
+    uint8_t _length;
+};
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ * OXRS_SchemaValidator.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_SchemaValidator.h"
+#include "OXRS_Hash.h"
+
+// Compiled property types
+#define       TYPE_ANY                    0
+#define       TYPE_BOOLEAN                1
+#define       TYPE_INTEGER                2
+#define       TYPE_NUMBER                 3
+#define       TYPE_STRING                 4
+#define       TYPE_ARRAY                  5
+#define       TYPE_OBJECT                 6
+
+// Compiled property flags
+#define       FLAG_MINIMUM                0x01
+#define       FLAG_MAXIMUM                0x02
+#define       FLAG_ITEMS                  0x04
+
+// Parent id of top-level properties (compiled ids start at 1)
+#define       NO_PARENT                   0
+
+static uint8_t _getType(JsonVariantConst type)
+{
+  // Anything other than a single type string (e.g. ["string", "null"]) is not checked
+  if (!type.is<const char *>()) { return TYPE_ANY; }
+
+  const char * name = type.as<const char *>();
+  if (strcmp(name, "boolean") == 0) { return TYPE_BOOLEAN; }
+  if (strcmp(name, "integer") == 0) { return TYPE_INTEGER; }
+  if (strcmp(name, "number") == 0)  { return TYPE_NUMBER; }
+  if (strcmp(name, "string") == 0)  { return TYPE_STRING; }
+  if (strcmp(name, "array") == 0)   { return TYPE_ARRAY; }
+  if (strcmp(name, "object") == 0)  { return TYPE_OBJECT; }
+  return TYPE_ANY;
+}
+
+static uint32_t _hashValue(JsonVariantConst value)
+{
+  OXRS_HashPrint hash;
+  serializeJson(value, hash);
+  return hash.hash;
+}
+
+OXRS_SchemaValidator::OXRS_SchemaValidator() : _properties(SCHEMA_VALIDATOR_SIZE)
+{
+  _enums = NULL;
+  _enumCount = 0;
+}
+
+OXRS_SchemaValidator::~OXRS_SchemaValidator()
+{
+  _clear();
+}
+
+void OXRS_SchemaValidator::compile(JsonVariantConst properties)
+{
+  _clear();
+
+  if (!properties.is<JsonObjectConst>()) { return; }
+
+  // Size the enum table first so it is allocated exactly once
+  uint16_t enumCount = _countEnums(properties.as<JsonObjectConst>());
+
+  _enums = (uint32_t *)malloc((enumCount ? enumCount : 1) * sizeof(uint32_t));
+  if (!_enums) { return; }
+
+  // Don't validate against a partial schema if we run out of memory
+  if (!_compileProperties(properties.as<JsonObjectConst>(), OXRS_HASH_SEED, NO_PARENT))
+  {
+    _clear();
+  }
+}
+
+uint8_t OXRS_SchemaValidator::validate(JsonVariant json, schemaErrorCallback onError)
+{
+  if (_properties.count() == 0 || !json.is<JsonObject>()) { return 0; }
+  return _validateObject(json.as<JsonObject>(), OXRS_HASH_SEED, NO_PARENT, NULL, onError);
+}
+
+void OXRS_SchemaValidator::_clear(void)
+{
+  _properties.each([](_property & property) { free(property.key); });
+  _properties.clear();
+
+  free(_enums);
+  _enums = NULL;
+  _enumCount = 0;
+}
+
+uint16_t OXRS_SchemaValidator::_countEnums(JsonObjectConst properties)
+{
+  uint16_t enumCount = 0;
+  for (JsonPairConst kvp : properties)
+  {
+    enumCount += kvp.value()["enum"].size();
+
+    JsonObjectConst items = kvp.value()["items"]["properties"];
+    if (!items.isNull())
+    {
+      enumCount += _countEnums(items);
+    }
+  }
+
+  return enumCount;
+}
+
+bool OXRS_SchemaValidator::_compileProperties(JsonObjectConst properties, uint32_t seed, uint16_t parentId)
+{
+  for (JsonPairConst kvp : properties)
+  {
+    JsonVariantConst schema = kvp.value();
+
+    // Keep our own copy of the key, the schema may not outlive us
+    char * key = strdup(kvp.key().c_str());
+    if (!key) { return false; }
+
+    uint32_t hash = _table::slotHash(oxrsHash(key, seed));
+    _property * property = _properties.insert(hash);
+    if (!property)
+    {
+      free(key);
+      return false;
+    }
+
+    property->key = key;
+    property->id = _properties.count();
+    property->parentId = parentId;
+    property->type = _getType(schema["type"]);
+    property->flags = 0;
+
+    if (schema["minimum"].is<float>())
+    {
+      property->minimum = schema["minimum"].as<float>();
+      property->flags |= FLAG_MINIMUM;
+    }
+
+    if (schema["maximum"].is<float>())
+    {
+      property->maximum = schema["maximum"].as<float>();
+      property->flags |= FLAG_MAXIMUM;
+    }
+
+    property->enumIndex = _enumCount;
+    property->enumCount = 0;
+    for (JsonVariantConst value : schema["enum"].as<JsonArrayConst>())
+    {
+      _enums[_enumCount++] = _hashValue(value);
+      property->enumCount++;
+    }
+
+    // Arrays of objects (i.e. indexed channel config) have their item
+    // properties compiled too, keyed by the parent (compiling them can
+    // grow the table, so property is not used after this)
+    JsonObjectConst items = schema["items"]["properties"];
+    if (!items.isNull())
+    {
+      property->flags |= FLAG_ITEMS;
+      if (!_compileProperties(items, hash, property->id)) { return false; }
+    }
+  }
+
+  return true;
+}
+
+const OXRS_SchemaValidator::_property * OXRS_SchemaValidator::_find(const char * key, uint32_t seed, uint16_t parentId)
+{
+  // Hashes can collide, so confirm the key (and parent) itself
+  return _properties.find(_table::slotHash(oxrsHash(key, seed)), [key, parentId](const _property & property) { return property.parentId == parentId && strcmp(property.key, key) == 0; });
+}
+
+uint8_t OXRS_SchemaValidator::_check(const _property * property, JsonVariantConst value)
+{
+  switch (property->type)
+  {
+    case TYPE_BOOLEAN:
+      if (!value.is<bool>()) { return SCHEMA_ERR_TYPE; }
+      break;
+    case TYPE_INTEGER:
+      if (!value.is<long>()) { return SCHEMA_ERR_TYPE; }
+      break;
+    case TYPE_NUMBER:
+      if (!value.is<float>()) { return SCHEMA_ERR_TYPE; }
+      break;
+    case TYPE_STRING:
+      if (!value.is<const char *>()) { return SCHEMA_ERR_TYPE; }
+      break;
+    case TYPE_ARRAY:
+      if (!value.is<JsonArrayConst>()) { return SCHEMA_ERR_TYPE; }
+      break;
+    case TYPE_OBJECT:
+      if (!value.is<JsonObjectConst>()) { return SCHEMA_ERR_TYPE; }
+      break;
+  }
+
+  if ((property->flags & (FLAG_MINIMUM | FLAG_MAXIMUM)) && value.is<float>())
+  {
+    float number = value.as<float>();
+    if ((property->flags & FLAG_MINIMUM) && number < property->minimum) { return SCHEMA_ERR_MINIMUM; }
+    if ((property->flags & FLAG_MAXIMUM) && number > property->maximum) { return SCHEMA_ERR_MAXIMUM; }
+  }
+
+  if (property->enumCount > 0)
+  {
+    uint32_t hash = _hashValue(value);
+    for (uint16_t i = property->enumIndex; i < property->enumIndex + property->enumCount; i++)
+    {
+      if (_enums[i] == hash) { return 0; }
+    }
+    return SCHEMA_ERR_ENUM;
+  }
+
+  return 0;
+}
+
+uint8_t OXRS_SchemaValidator::_validateObject(JsonObject json, uint32_t seed, uint16_t parentId, const char * parent, schemaErrorCallback onError)
+{
+  uint8_t removed = 0;
+
+  JsonObject::iterator it = json.begin();
+  while (it != json.end())
+  {
+    JsonObject::iterator next = it;
+    ++next;
+
+    // Keys not in the schema are passed through untouched
+    const char * key = it->key().c_str();
+    const _property * property = _find(key, seed, parentId);
+    if (property)
+    {
+      uint8_t error = _check(property, it->value());
+      if (error)
+      {
+        if (onError) { onError(parent, key, error); }
+        json.remove(it);
+        removed++;
+      }
+      else if (property->flags & FLAG_ITEMS)
+      {
+        for (JsonVariant item : it->value().as<JsonArray>())
+        {
+          if (item.is<JsonObject>())
+          {
+            removed += _validateObject(item.as<JsonObject>(), property->hash, property->id, key, onError);
+          }
+        }
+      }
+    }
+
+    it = next;
+  }
+
+  return removed;
+}
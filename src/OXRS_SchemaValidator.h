@@ -0,0 +1,67 @@
+/*
+ * OXRS_SchemaValidator.h
+ */
+
+#ifndef OXRS_SchemaValidator_H
+#define OXRS_SchemaValidator_H
+
+#include <ArduinoJson.h>
+#include "OXRS_HashTable.h"
+
+// Initial table size (must be a power of 2), grows as properties are compiled
+#define       SCHEMA_VALIDATOR_SIZE       32
+
+// Validation errors
+#define       SCHEMA_ERR_TYPE             1
+#define       SCHEMA_ERR_MINIMUM          2
+#define       SCHEMA_ERR_MAXIMUM          3
+#define       SCHEMA_ERR_ENUM             4
+
+// Called for each invalid key (parent is NULL for top-level keys)
+typedef void (*schemaErrorCallback)(const char * parent, const char * key, uint8_t error);
+
+class OXRS_SchemaValidator
+{
+  public:
+    OXRS_SchemaValidator();
+    ~OXRS_SchemaValidator();
+
+    // Compile the "properties" of a json schema into a lookup table,
+    // including the item properties of any arrays of objects
+    void compile(JsonVariantConst properties);
+
+    // Check a payload in a single pass, removing (and reporting) any
+    // invalid keys - returns the number of keys removed
+    uint8_t validate(JsonVariant json, schemaErrorCallback onError);
+
+  private:
+    // Item properties are keyed on their parent property's id + key
+    struct _property
+    {
+      uint32_t hash;
+      char * key;
+      uint16_t id;
+      uint16_t parentId;
+      float minimum;
+      float maximum;
+      uint16_t enumIndex;
+      uint8_t enumCount;
+      uint8_t type;
+      uint8_t flags;
+    };
+
+    typedef OXRS_HashTable<_property> _table;
+    _table _properties;
+
+    uint32_t * _enums;
+    uint16_t _enumCount;
+
+    void _clear(void);
+    uint16_t _countEnums(JsonObjectConst properties);
+    bool _compileProperties(JsonObjectConst properties, uint32_t seed, uint16_t parentId);
+    const _property * _find(const char * key, uint32_t seed, uint16_t parentId);
+    uint8_t _check(const _property * property, JsonVariantConst value);
+    uint8_t _validateObject(JsonObject json, uint32_t seed, uint16_t parentId, const char * parent, schemaErrorCallback onError);
+};
+
+#endif
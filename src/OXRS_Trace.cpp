@@ -0,0 +1,80 @@
+/*
+ * OXRS_Trace.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_Trace.h"
+
+#include <esp_timer.h>                // For esp_timer_get_time()
+
+OXRS_Trace::OXRS_Trace(uint16_t size)
+{
+  // Slots are found by masking, so keep the largest power of 2 that fits
+  _size = 1;
+  while (_size <= size / 2) { _size <<= 1; }
+
+  _events = new _event[_size];
+  _next.store(0);
+  _frozen.store(false);
+
+  for (uint16_t i = 0; i < _size; i++)
+  {
+    _events[i].sequence.store(0);
+  }
+}
+
+void OXRS_Trace::_record(const char * name, char phase)
+{
+  if (_frozen.load(std::memory_order_relaxed)) { return; }
+
+  // Claim a slot, then publish it by writing its sequence number last so
+  // readers can tell a complete event from one being overwritten
+  uint32_t sequence = _next.fetch_add(1, std::memory_order_relaxed) + 1;
+  _event * event = &_events[sequence & (_size - 1)];
+
+  event->sequence.store(0, std::memory_order_relaxed);
+  event->name = name;
+  event->timestampUs = (uint32_t)esp_timer_get_time();
+  event->phase = phase;
+  event->task = (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+  event->sequence.store(sequence, std::memory_order_release);
+}
+
+void OXRS_Trace::print(Print & out)
+{
+  uint32_t last = _next.load(std::memory_order_acquire);
+  uint32_t first = last > _size ? last - _size + 1 : 1;
+
+  out.print(F("{\"traceEvents\":["));
+
+  bool comma = false;
+  for (uint32_t sequence = first; sequence <= last; sequence++)
+  {
+    _event * event = &_events[sequence & (_size - 1)];
+
+    // Copy the event, and skip it if it was overwritten while copying
+    if (event->sequence.load(std::memory_order_acquire) != sequence) { continue; }
+    const char * name = event->name;
+    uint32_t timestampUs = event->timestampUs;
+    char phase = event->phase;
+    uint32_t task = event->task;
+    if (event->sequence.load(std::memory_order_acquire) != sequence) { continue; }
+
+    if (comma) { out.print(','); }
+    comma = true;
+
+    out.print(F("{\"name\":\""));
+    out.print(name);
+    out.print(F("\",\"ph\":\""));
+    out.print(phase);
+    out.print(F("\",\"ts\":"));
+    out.print(timestampUs);
+    out.print(F(",\"pid\":0,\"tid\":"));
+    out.print(task);
+    out.print('}');
+  }
+
+  out.print(F("]}"));
+
+  _frozen.store(false);
+}
@@ -0,0 +1,70 @@
+/*
+ * OXRS_Trace.h
+ */
+
+#ifndef OXRS_Trace_H
+#define OXRS_Trace_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Number of events kept by default (must be a power of 2), oldest are overwritten
+#ifndef TRACE_BUFFER_SIZE
+#define       TRACE_BUFFER_SIZE           256
+#endif
+
+static_assert((TRACE_BUFFER_SIZE & (TRACE_BUFFER_SIZE - 1)) == 0, "TRACE_BUFFER_SIZE must be a power of 2");
+
+// Lock-free ring buffer of begin/end events, which can be recorded from
+// any task and exported in Chrome trace event format (chrome://tracing)
+class OXRS_Trace
+{
+  public:
+    // Size must be a power of 2 (anything else is rounded down)
+    OXRS_Trace(uint16_t size = TRACE_BUFFER_SIZE);
+
+    // Names must be string literals (only the pointer is stored)
+    void begin(const char * name) { _record(name, 'B'); }
+    void end(const char * name) { _record(name, 'E'); }
+
+    // Stop recording, so whatever led up to now (e.g. a stall) is kept
+    // until it is printed, rather than overwritten by what follows
+    void freeze(void) { _frozen.store(true); }
+    bool frozen(void) { return _frozen.load(); }
+
+    // Write the buffer as Chrome trace json, oldest event first (and
+    // resume recording if frozen)
+    void print(Print & out);
+
+  private:
+    struct _event
+    {
+      std::atomic<uint32_t> sequence;
+      const char * name;
+      uint32_t timestampUs;
+      uint32_t task;
+      uint8_t phase;
+    };
+
+    _event * _events;
+    uint16_t _size;
+    std::atomic<uint32_t> _next;
+    std::atomic<bool> _frozen;
+
+    void _record(const char * name, char phase);
+};
+
+// Records a begin event now, and the matching end event when it goes
+// out of scope
+class OXRS_TraceScope
+{
+  public:
+    OXRS_TraceScope(OXRS_Trace & trace, const char * name) : _trace(&trace), _name(name) { _trace->begin(_name); }
+    ~OXRS_TraceScope() { _trace->end(_name); }
+
+  private:
+    OXRS_Trace * _trace;
+    const char * _name;
+};
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * OXRS_W5500Health.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_W5500Health.h"
+
+#include <SPI.h>
+#include <utility/w5100.h>            // For W5500 register access
+
+// W5500 version register (at the address the Ethernet library maps it to),
+// and the version every W5500 reports, see the W5500 datasheet section 4
+#define       W5500_VERSIONR              0x0039
+#define       W5500_VERSION               0x04
+
+// Socket states (Sn_SR), anything else is garbage off the SPI bus
+#define       W5500_SOCK_ESTABLISHED      0x17
+#define       W5500_SOCK_CLOSE_WAIT       0x1C
+
+static const uint8_t W5500_SOCK_STATES[] = { 0x00, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x1A, 0x1B, 0x1C, 0x1D, 0x22, 0x32, 0x42 };
+
+OXRS_W5500Health::OXRS_W5500Health()
+{
+  recoveries = 0;
+
+  _resetPin = 0;
+  _enabled = false;
+  _lastCheckMs = 0;
+  _failures = 0;
+  _fault = NULL;
+  _txPending = 0;
+}
+
+void OXRS_W5500Health::begin(uint8_t resetPin)
+{
+  _resetPin = resetPin;
+  _enabled = true;
+  _lastCheckMs = millis();
+  _failures = 0;
+  _txPending = 0;
+
+  _saveSettings();
+}
+
+bool OXRS_W5500Health::check(void)
+{
+  if (!_enabled) { return true; }
+  if ((millis() - _lastCheckMs) < W5500_HEALTH_CHECK_MS) { return true; }
+  _lastCheckMs = millis();
+
+  if (!_checkChip())
+  {
+    return ++_failures < W5500_HEALTH_FAILURES;
+  }
+
+  // Healthy, so these are the settings to restore if it wedges later on
+  _failures = 0;
+  _saveSettings();
+  return true;
+}
+
+void OXRS_W5500Health::recover(void)
+{
+  digitalWrite(_resetPin, LOW);
+  delay(W5500_RESET_PULSE_MS);
+  digitalWrite(_resetPin, HIGH);
+  delay(W5500_RESET_SETTLE_MS);
+
+  // Everything else the Ethernet library set up (socket buffer sizes) is
+  // the W5500 default, so only our addresses need restoring
+  Ethernet.setMACAddress(_mac);
+  Ethernet.setLocalIP(_ip);
+  Ethernet.setSubnetMask(_subnet);
+  Ethernet.setGatewayIP(_gateway);
+
+  recoveries++;
+  _lastCheckMs = millis();
+  _failures = 0;
+  _txPending = 0;
+}
+
+bool OXRS_W5500Health::_checkChip(void)
+{
+  uint32_t now = millis();
+  bool healthy = true;
+  bool txStuck = false;
+
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+
+  if (W5100.read(W5500_VERSIONR) != W5500_VERSION)
+  {
+    _fault = "version register";
+    healthy = false;
+  }
+
+  for (uint8_t s = 0; healthy && s < MAX_SOCK_NUM; s++)
+  {
+    uint8_t state = W5100.readSnSR(s);
+    if (memchr(W5500_SOCK_STATES, state, sizeof(W5500_SOCK_STATES)) == NULL)
+    {
+      _fault = "socket state";
+      healthy = false;
+      break;
+    }
+
+    // Connected sockets with data waiting to go should be sending it - if
+    // the peer stops acking the W5500 times out and closes the socket, but
+    // a peer advertising a zero window can hold it up indefinitely
+    bool connected = state == W5500_SOCK_ESTABLISHED || state == W5500_SOCK_CLOSE_WAIT;
+    if (!connected || W5100.readSnTX_FSR(s) >= W5100.SSIZE)
+    {
+      bitClear(_txPending, s);
+      continue;
+    }
+
+    uint16_t txRead = W5100.readSnTX_RD(s);
+    if (!bitRead(_txPending, s) || txRead != _txRead[s])
+    {
+      bitSet(_txPending, s);
+      _txRead[s] = txRead;
+      _txMovedMs[s] = now;
+    }
+    else if ((now - _txMovedMs[s]) >= W5500_TX_STUCK_MS)
+    {
+      txStuck = true;
+    }
+  }
+
+  SPI.endTransaction();
+
+  // The W5500 doesn't expose the peer's window, so check it can still send
+  // at all before blaming the chip (done outside our SPI transaction)
+  if (healthy && txStuck && !_canSend())
+  {
+    _fault = "tx stuck";
+    healthy = false;
+  }
+
+  return healthy;
+}
+
+bool OXRS_W5500Health::_canSend(void)
+{
+  // Can't tell without somewhere to send to, or a free socket
+  if (_gateway == IPAddress(0, 0, 0, 0)) { return true; }
+
+  EthernetUDP udp;
+  if (!udp.begin(W5500_PROBE_LOCAL_PORT)) { return true; }
+
+  // endPacket() waits for the W5500 to report the datagram sent (or
+  // time out, e.g. if it can't even resolve the gateway)
+  bool sent = udp.beginPacket(_gateway, W5500_PROBE_REMOTE_PORT) &&
+              udp.write((uint8_t)0) == 1 &&
+              udp.endPacket();
+
+  udp.stop();
+  return sent;
+}
+
+void OXRS_W5500Health::_saveSettings(void)
+{
+  Ethernet.MACAddress(_mac);
+  _ip = Ethernet.localIP();
+  _subnet = Ethernet.subnetMask();
+  _gateway = Ethernet.gatewayIP();
+}
@@ -0,0 +1,79 @@
+/*
+ * OXRS_W5500Health.h
+ */
+
+#ifndef OXRS_W5500Health_H
+#define OXRS_W5500Health_H
+
+#include <Arduino.h>
+#include <Ethernet.h>
+
+// How often the W5500 is checked, and how long data can sit unsent in a
+// connected socket before we decide the chip has wedged
+#define       W5500_HEALTH_CHECK_MS       5000
+#define       W5500_TX_STUCK_MS           10000
+
+// Consecutive failed checks before the W5500 is reset, so a single bad
+// read doesn't drop every connection
+#define       W5500_HEALTH_FAILURES       3
+
+// Stuck TX is confirmed by sending a datagram to the gateway's discard
+// port - if that goes, the chip is fine and the peer has closed its window
+#define       W5500_PROBE_LOCAL_PORT      4097
+#define       W5500_PROBE_REMOTE_PORT     9
+
+// Recovery reset pulse (the datasheet minimum is 500us) and the time
+// allowed for the PLL to lock and the PHY to come back up
+#define       W5500_RESET_PULSE_MS        2
+#define       W5500_RESET_SETTLE_MS       50
+
+// Watches for the W5500 wedging (we have seen the link stay up with no
+// traffic flowing) and resets it in place, restoring the network settings
+// from the last healthy check, rather than restarting the ESP32
+class OXRS_W5500Health
+{
+  public:
+    OXRS_W5500Health();
+
+    // Start monitoring, once the W5500 is up and configured
+    void begin(uint8_t resetPin);
+
+    // Check the version register, socket states and that connected
+    // sockets are still sending (if due) - returns false once enough
+    // consecutive checks have failed that the chip looks wedged
+    bool check(void);
+
+    // Pulse the reset pin and restore the network settings, leaving
+    // every socket closed
+    void recover(void);
+
+    // What the last failed check found
+    const char * getFault(void) { return _fault; }
+
+    // Recoveries since boot
+    uint32_t recoveries;
+
+  private:
+    uint8_t _resetPin;
+    bool _enabled;
+    uint32_t _lastCheckMs;
+    uint8_t _failures;
+    const char * _fault;
+
+    // Network settings as of the last healthy check
+    byte _mac[6];
+    IPAddress _ip;
+    IPAddress _subnet;
+    IPAddress _gateway;
+
+    // Per socket TX read pointer, and when it last moved (while data is pending)
+    uint16_t _txRead[MAX_SOCK_NUM];
+    uint32_t _txMovedMs[MAX_SOCK_NUM];
+    uint8_t _txPending;
+
+    bool _checkChip(void);
+    bool _canSend(void);
+    void _saveSettings(void);
+};
+
+#endif
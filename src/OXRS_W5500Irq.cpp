@@ -0,0 +1,85 @@
+/*
+ * OXRS_W5500Irq.cpp
+ */
+
+#include "Arduino.h"
+#include "OXRS_W5500Irq.h"
+
+#include <SPI.h>
+#include <utility/w5100.h>            // For W5500 register access
+
+// W5500 registers (at the addresses the Ethernet library maps them to),
+// see the W5500 datasheet section 4
+#define       W5500_SIMR                  0x0018
+#define       W5500_SIR                   0x0017
+#define       W5500_SN_IMR(s)             (0x1000 + ((s) << 8) + 0x002C)
+
+// Sn_IR bits we are interested in (not SEND_OK, which the Ethernet library
+// polls and clears itself on every send)
+#define       W5500_SN_IR_CON             0x01
+#define       W5500_SN_IR_DISCON          0x02
+#define       W5500_SN_IR_RECV            0x04
+#define       W5500_SN_IR_TIMEOUT         0x08
+#define       W5500_SN_IR_EVENTS          (W5500_SN_IR_CON | W5500_SN_IR_DISCON | W5500_SN_IR_RECV | W5500_SN_IR_TIMEOUT)
+
+// Set from the ISR (there is only one W5500)
+static volatile bool _flagged = false;
+
+static void IRAM_ATTR _isr(void)
+{
+  _flagged = true;
+}
+
+OXRS_W5500Irq::OXRS_W5500Irq()
+{
+  serviced = 0;
+
+  _pin = 0;
+  _enabled = false;
+}
+
+void OXRS_W5500Irq::begin(uint8_t pin)
+{
+  if (_enabled) { detachInterrupt(digitalPinToInterrupt(_pin)); }
+
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  for (uint8_t s = 0; s < W5500_SOCKETS; s++)
+  {
+    W5100.write(W5500_SN_IMR(s), W5500_SN_IR_EVENTS);
+    W5100.writeSnIR(s, W5500_SN_IR_EVENTS);
+  }
+  W5100.write(W5500_SIMR, W5500_ALL_SOCKETS);
+  SPI.endTransaction();
+
+  // INT is active low, and held low until every event is cleared
+  pinMode(pin, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(pin), _isr, FALLING);
+
+  _pin = pin;
+  _enabled = true;
+
+  // Service anything that arrived before we were attached
+  _flagged = true;
+}
+
+uint8_t OXRS_W5500Irq::take(void)
+{
+  if (!_enabled || !_flagged) { return 0; }
+  _flagged = false;
+
+  serviced++;
+
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  uint8_t sockets = W5100.read(W5500_SIR);
+  for (uint8_t s = 0; s < W5500_SOCKETS; s++)
+  {
+    if (bitRead(sockets, s)) { W5100.writeSnIR(s, W5500_SN_IR_EVENTS); }
+  }
+  SPI.endTransaction();
+
+  // Anything raised while we were clearing keeps INT low without another
+  // falling edge, so check again next time
+  if (digitalRead(_pin) == LOW) { _flagged = true; }
+
+  return sockets;
+}
@@ -0,0 +1,41 @@
+/*
+ * OXRS_W5500Irq.h
+ */
+
+#ifndef OXRS_W5500Irq_H
+#define OXRS_W5500Irq_H
+
+#include <Arduino.h>
+
+// All W5500 sockets
+#define       W5500_SOCKETS               8
+#define       W5500_ALL_SOCKETS           0xFF
+
+// Flags socket events (data received, connected, disconnected, timed out)
+// raised on the W5500 INT pin, so sockets are only serviced when they have
+// something to do rather than polled over SPI every loop
+class OXRS_W5500Irq
+{
+  public:
+    OXRS_W5500Irq();
+
+    // Attach to the INT pin and unmask socket events on the W5500 - call
+    // once the W5500 is up, and again after anything resets it
+    void begin(uint8_t pin);
+
+    // True once attached to the INT pin
+    bool enabled(void) { return _enabled; }
+
+    // Bitmask of sockets with events since the last call (clearing them
+    // on the W5500, which is only read if the interrupt has fired)
+    uint8_t take(void);
+
+    // Interrupts serviced
+    uint32_t serviced;
+
+  private:
+    uint8_t _pin;
+    bool _enabled;
+};
+
+#endif